@@ -1,6 +1,7 @@
 #include <charconv>
 #include "ArgumentParser.h"
 #include "Helper.h"
+#include "Logger.h"
 
 using namespace route_app;
 using namespace std;
@@ -10,7 +11,7 @@ ArgumentParser::ArgumentParser(const int& argc, char** argv) {
 }
 
 void ArgumentParser::Initialize(const int& argc, char** argv) {
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "Initializing argument parser...", true);
+	LOG_DEBUG("ArgumentParser", "Initializing argument parser...");
 	Reset();
 	previous_parser_state_ = current_parser_state_;
 	current_input_state_ = InputState::INVALID;
@@ -18,6 +19,43 @@ void ArgumentParser::Initialize(const int& argc, char** argv) {
 	bound_query_ = "";
 	syntax_state_ = 0x00;
 	CreateStateTable();
+	RegisterOptions();
+}
+
+void ArgumentParser::RegisterOptions() {
+	value_options_.insert("-layers");
+	value_options_.insert("-osc");
+	value_options_.insert("-compare");
+	value_options_.insert("-url");
+	value_options_.insert("-tile_size");
+	value_options_.insert("-parallel");
+	value_options_.insert("-retries");
+	value_options_.insert("-cache");
+	value_options_.insert("-cache_size");
+	value_options_.insert("-cache_max_age");
+	value_options_.insert("-serve");
+	value_options_.insert("-threads");
+	value_options_.insert("-zoom");
+	value_options_.insert("-center");
+	value_options_.insert("-png");
+	value_options_.insert("-batch");
+	value_options_.insert("-size");
+	value_options_.insert("-render_tiles");
+	value_options_.insert("-tile_zoom");
+	value_options_.insert("-frame_benchmark");
+	value_options_.insert("-metrics");
+	value_options_.insert("-trace");
+	value_options_.insert("-log_level");
+	value_options_.insert("-log_file");
+	value_options_.insert("-query_log");
+	value_options_.insert("-matrix");
+	value_options_.insert("-sources");
+	value_options_.insert("-targets");
+	value_options_.insert("-stops");
+	value_options_.insert("-tour");
+	value_options_.insert("-tour_budget");
+	flag_options_.insert("-pipeline");
+	flag_options_.insert("-raster_cache");
 }
 
 void ArgumentParser::Reset() {
@@ -38,10 +76,14 @@ void ArgumentParser::CreateStateTable() {
 	stateTable_->SetState(ParserState::START_STATE, InputState::START_POINT_COMMAND, ParserState::POINT_STATE);
 	stateTable_->SetState(ParserState::START_STATE, InputState::END_POINT_COMMAND, ParserState::POINT_STATE);
 	stateTable_->SetState(ParserState::START_STATE, InputState::POINT_COMMAND, ParserState::POINT_STATE);
+	stateTable_->SetState(ParserState::START_STATE, InputState::OPTION_COMMAND, ParserState::OPTION_STATE);
+	stateTable_->SetState(ParserState::START_STATE, InputState::FLAG_COMMAND, ParserState::START_STATE);
 
 	stateTable_->SetState(ParserState::BOUNDS_STATE, InputState::COORDINATE, ParserState::PARSING_STATE);
 	stateTable_->SetState(ParserState::POINT_STATE, InputState::COORDINATE, ParserState::PARSING_STATE);
 	stateTable_->SetState(ParserState::FILE_STATE, InputState::FILENAME, ParserState::PARSING_STATE);
+	stateTable_->SetState(ParserState::OPTION_STATE, InputState::FILENAME, ParserState::PARSING_STATE);
+	stateTable_->SetState(ParserState::OPTION_STATE, InputState::COORDINATE, ParserState::PARSING_STATE);
 
 	stateTable_->SetState(ParserState::PARSING_STATE, InputState::COORDINATE, ParserState::PARSING_STATE);
 	stateTable_->SetState(ParserState::PARSING_STATE, InputState::FILENAME, ParserState::PARSING_STATE);
@@ -72,45 +114,46 @@ bool ArgumentParser::SyntaxAnalysis(const int& argc, char** argv) {
 }
 
 void ArgumentParser::DefaultSyntaxExample() {
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "Did not find any command line arguments. Using default values instead.", true);
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "Example of correct command line argument usage:", false);
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "RouteApplication.exe -b 23.7255 37.9666 23.7315 37.9705 -start 0.25 0.25 -end 0.75 0.75", false);
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "Generating a map of Athens, Greece.", false);
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "bounds:\t[-b 23.7255 37.9666 23.7315 37.9705]", false);
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "start:\t[-start 0.25 0.25]", false);
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "end:\t[-end 0.75 0.75]", false);
+	LOG_INFO("ArgumentParser", "Did not find any command line arguments. Using default values instead.");
+	LOG_INFO("ArgumentParser", "Example of correct command line argument usage:");
+	LOG_INFO("ArgumentParser", "RouteApplication.exe -b 23.7255 37.9666 23.7315 37.9705 -start 0.25 0.25 -end 0.75 0.75");
+	LOG_INFO("ArgumentParser", "Generating a map of Athens, Greece.");
+	LOG_INFO("ArgumentParser", "bounds:\t[-b 23.7255 37.9666 23.7315 37.9705]");
+	LOG_INFO("ArgumentParser", "start:\t[-start 0.25 0.25]");
+	LOG_INFO("ArgumentParser", "end:\t[-end 0.75 0.75]");
 
 	bound_query_ = "23.7255,37.9666,23.7315,37.9705";
 	syntax_state_ = (int)SyntaxFlags::BOUNDS;
 }
 
 bool ArgumentParser::CheckForMissingArgumentError(const int& argc, char** argv, const int i) {
-	if (i + number_of_coordinates_to_parse >= argc) {
-		cout << "Error parsing arguments: Coordinate argument is missing:" << endl;
-		cout << "'";
+	bool missing_option_value = current_input_state_ == InputState::OPTION_COMMAND && i + 1 >= argc;
+	if (i + number_of_coordinates_to_parse >= argc || missing_option_value) {
+		string command_line;
 		for (int j = 0; j < argc; j++) {
-			cout << argv[j] << " ";
+			command_line += string(argv[j]) + " ";
 		}
-		cout << "[missing argument]'" << endl;
+		LOG_ERROR("ArgumentParser", "Error parsing arguments: Coordinate argument is missing:");
+		LOG_ERROR("ArgumentParser", "'{}[missing argument]'", command_line);
 		return true;
 	}
 	return false;
 }
 
 bool ArgumentParser::CheckForWrongArgumentError(const int& argc, char** argv, const int i) {
-		cout << "'";
+		string command_line;
 		for (int j = 0; j < argc; j++) {
 			if (argv[j] == argv[i]) {
-				cout << "[wrong argument: " << argv[j] << "]";
+				command_line += "[wrong argument: " + string(argv[j]) + "]";
 			}
 			else {
-				cout << argv[j];
+				command_line += argv[j];
 			}
 			if (j != argc - 1) {
-				cout << " ";
+				command_line += " ";
 			}
 		}
-		cout << "'" << endl;
+		LOG_ERROR("ArgumentParser", "'{}'", command_line);
 		return true;
 }
 
@@ -127,10 +170,15 @@ bool ArgumentParser::CheckForSyntaxError() {
 	case (int)SyntaxFlags::POINT | (int)SyntaxFlags::FILE:
 		break;
 	default:
-		cout << "Error: Incorrect command line argument syntax. Must provide the application with an areas' bounds, a point coordinate or a OSM data file." << endl;
+		LOG_ERROR("ArgumentParser", "Error: Incorrect command line argument syntax. Must provide the application with an areas' bounds, a point coordinate or a OSM data file.");
+		return true;
+	}
+	// -layers drops the nodes that no loaded way uses, which a changed way of -osc may still refer to.
+	if (HasOption("-layers") && HasOption("-osc")) {
+		LOG_ERROR("ArgumentParser", "Error: -layers cannot be combined with -osc.");
 		return true;
 	}
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "Syntax analysis completed successfully.", false);
+	LOG_DEBUG("ArgumentParser", "Syntax analysis completed successfully.");
 	return false;
 }
 
@@ -168,6 +216,14 @@ void ArgumentParser::UpdateInputState(string_view arg) {
 		current_input_state_ = InputState::END_POINT_COMMAND;
 		number_of_coordinates_to_parse = point_coordinates_;
 	}
+	else if (value_options_.count(string(arg))) {
+		current_input_state_ = InputState::OPTION_COMMAND;
+		current_option_ = arg;
+	}
+	else if (flag_options_.count(string(arg))) {
+		current_input_state_ = InputState::FLAG_COMMAND;
+		options_[string(arg)] = "";
+	}
 	else {
 		double result;
 		if (auto [p, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), result); ec == std::errc()) {
@@ -195,17 +251,17 @@ ArgumentParser::ParserState ArgumentParser::ValidateParsingState(string_view arg
 	switch (current_parser_state_) {
 	case ParserState::PARSING_STATE:
 		if (number_of_coordinates_to_parse >= 1 && current_input_state_ == InputState::FILENAME) {
-			cout << "Error parsing arguments: was expecting a coordinate as an argument. Instead, parsed '" << arg << "'." << endl;
+			LOG_ERROR("ArgumentParser", "Error parsing arguments: was expecting a coordinate as an argument. Instead, parsed '{}'.", arg);
 			return ParserState::ERROR_STATE;
 		}
 		break;
 	case ParserState::ERROR_STATE:
 		switch (current_input_state_) {
 		case InputState::COORDINATE:
-			cout << "Error parsing arguments: was not expecting a coordinate as an argument." << endl;
+			LOG_ERROR("ArgumentParser", "Error parsing arguments: was not expecting a coordinate as an argument.");
 			break;
 		default:
-			cout << "Error parsing arguments: was not expecting a string as an argument." << endl;
+			LOG_ERROR("ArgumentParser", "Error parsing arguments: was not expecting a string as an argument.");
 			break;
 		}
 		break;
@@ -224,6 +280,9 @@ void ArgumentParser::StoreData(string_view arg) {
 	case InputState::FILE_COMMAND:
 		filename_ = arg;
 		break;
+	case InputState::OPTION_COMMAND:
+		options_[current_option_] = arg;
+		break;
 	case InputState::START_POINT_COMMAND:
 		number_of_coordinates_to_parse--;
 		if (number_of_coordinates_to_parse == 0) {
@@ -248,7 +307,7 @@ void ArgumentParser::StoreData(string_view arg) {
 }
 
 void ArgumentParser::ResetParsingState() {
-	if (number_of_coordinates_to_parse == 0 || previous_input_state_ == InputState::FILE_COMMAND) {
+	if (number_of_coordinates_to_parse == 0 || previous_input_state_ == InputState::FILE_COMMAND || previous_input_state_ == InputState::OPTION_COMMAND) {
 		Reset();
 	}
 }
@@ -265,6 +324,47 @@ void inline ArgumentParser::InitializeBounds() {
 	bound_query_ += to_string(coords_[3]);
 }
 
+string ArgumentParser::GetOption(const string& name, const string& default_value) const {
+	if (auto it = options_.find(name); it != options_.end()) {
+		return it->second;
+	}
+	return default_value;
+}
+
+double ArgumentParser::GetNumericOption(const string& name, double default_value) const {
+	auto it = options_.find(name);
+	if (it == options_.end()) {
+		return default_value;
+	}
+	double result;
+	if (auto [p, ec] = std::from_chars(it->second.data(), it->second.data() + it->second.size(), result); ec == std::errc()) {
+		return result;
+	}
+	LOG_ERROR("ArgumentParser", "Error parsing arguments: was expecting a number after '{}'. Instead, parsed '{}'.", name, it->second);
+	return default_value;
+}
+
+// Parses the command lines of the tools, which only hold pairs of "-name value". set_option stores a pair
+// and returns false for an unknown name; a missing value or one that is not a number where one is
+// expected also fails the parse.
+bool ArgumentParser::ParseOptionPairs(int argc, char** argv, const function<bool(const string& name, const string& value)>& set_option) {
+	if (argc % 2 == 0) {
+		return false;
+	}
+	for (int i = 1; i + 1 < argc; i += 2) {
+		try {
+			if (!set_option(argv[i], argv[i + 1])) {
+				return false;
+			}
+		}
+		catch (const std::exception&) {
+			LOG_ERROR("ArgumentParser", "Error parsing arguments: '{}' is not a valid value for '{}'.", argv[i + 1], argv[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
 size_t inline ArgumentParser::StateTable::Index(int x, int y) const {
 	return x + width_ * y;
 }
@@ -285,7 +385,7 @@ int inline ArgumentParser::StateTable::GetState(ParserState x, InputState y) con
 }
 
 void ArgumentParser::Release() {
-	PrintDebugMessage(APPLICATION_NAME, "ArgumentParser", "Releasing parser resources...", false);
+	LOG_DEBUG("ArgumentParser", "Releasing parser resources...");
 	delete stateTable_;
 }
 
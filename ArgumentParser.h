@@ -2,17 +2,20 @@
 #ifndef ROUTE_APP_ARGUMENT_PARSER_H
 #define ROUTE_APP_ARGUMENT_PARSER_H
 
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
 #include "Model.h"
 
 namespace route_app {
 	class ArgumentParser {
 	public:
 		enum class ParserState {
-			OK_STATE = -2, ERROR_STATE = -1, START_STATE, BOUNDS_STATE, POINT_STATE, FILE_STATE, PARSING_STATE
+			OK_STATE = -2, ERROR_STATE = -1, START_STATE, BOUNDS_STATE, POINT_STATE, FILE_STATE, PARSING_STATE, OPTION_STATE
 		};
 
 		enum class InputState {
-			INVALID = -1, BOUNDS_COMMAND, FILE_COMMAND, START_POINT_COMMAND, END_POINT_COMMAND, POINT_COMMAND, COORDINATE, FILENAME
+			INVALID = -1, BOUNDS_COMMAND, FILE_COMMAND, START_POINT_COMMAND, END_POINT_COMMAND, POINT_COMMAND, COORDINATE, FILENAME, OPTION_COMMAND, FLAG_COMMAND
 		};
 
 		enum class SyntaxFlags {
@@ -29,12 +32,16 @@ namespace route_app {
 		Model::Node GetPoint() const { return point_; }
 		ParserState GetParserState() const { return current_parser_state_; }
 		int GetSyntaxState() const { return syntax_state_; }
+		bool HasOption(const std::string& name) const { return options_.count(name) != 0; }
+		std::string GetOption(const std::string& name, const std::string& default_value = "") const;
+		double GetNumericOption(const std::string& name, double default_value) const;
+		static bool ParseOptionPairs(int argc, char** argv, const std::function<bool(const std::string& name, const std::string& value)>& set_option);
 	private:
 		class StateTable {
 		private:
 			int* array;
-			const size_t width_ = 5;
-			const size_t height_ = 7;
+			const size_t width_ = 6;
+			const size_t height_ = 9;
 			size_t Index(int x, int y) const;
 		public:
 			StateTable() {
@@ -66,9 +73,14 @@ namespace route_app {
 		Model::Node ending_point_;
 		std::string bound_query_;
 		std::string filename_;
+		std::string current_option_;
+		std::unordered_set<std::string> value_options_;
+		std::unordered_set<std::string> flag_options_;
+		std::unordered_map<std::string, std::string> options_;
 		void Initialize(const int& argc, char** argv);
 		ParserState ParseArgument(std::string_view arg);
 		void CreateStateTable();
+		void RegisterOptions();
 		void UpdateInputState(std::string_view arg);
 		void UpdateParserState(std::string_view arg);
 		ParserState ValidateParsingState(std::string_view arg);
@@ -0,0 +1,172 @@
+#include <io2d.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "ArgumentParser.h"
+#include "Helper.h"
+#include "Metrics.h"
+#include "Model.h"
+#include "Pathfinder.h"
+#include "Renderer.h"
+
+using namespace std;
+using namespace route_app;
+
+// Measures the stages of the application one by one on a fixed map: loading and parsing the document,
+// stitching multipolygon rings, projecting the coordinates, building the road graph, routing between a
+// fixed set of random point pairs and drawing one frame offscreen. The results are written as JSON, so
+// that runs can be compared to find regressions. The loading stages are timed by the timers of Metrics.h,
+// which are always compiled into the library the benchmarks link; routes and frames are timed here.
+//
+// usage: benchmarks [-f stockholm.osm] [-iterations 10] [-queries 100] [-seed 1] [-output benchmarks.json]
+
+struct Options {
+    string filename = "stockholm.osm";
+    int iterations = 10;
+    int queries = 100;
+    unsigned int seed = 1;
+    string output = "benchmarks.json";
+};
+
+struct Result {
+    string name;
+    vector<double> samples;
+};
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    return ArgumentParser::ParseOptionPairs(argc, argv, [&options](const string& name, const string& value) {
+        if (name == "-f") options.filename = value;
+        else if (name == "-iterations") options.iterations = max(1, stoi(value));
+        else if (name == "-queries") options.queries = max(1, stoi(value));
+        else if (name == "-seed") options.seed = (unsigned int)stoul(value);
+        else if (name == "-output") options.output = value;
+        else return false;
+        return true;
+    });
+}
+
+// One sample per load and stage: the time the load added to the stage's timer. Parsing includes the
+// stitching of multipolygon rings, which is also given on its own.
+static void MeasureLoading(const Options& options, vector<Result>& results) {
+    const pair<const char*, const char*> stages[] = { { "Model::OpenDocument", "model.open_document" }, { "Model::ParseData", "model.parse_data" },
+        { "Model::BuildRings", "model.build_rings" }, { "Model::AdjustCoordinates", "model.adjust_coordinates" },
+        { "Model::CreateRoadGraph", "model.create_road_graph" } };
+    vector<Result> loading;
+    vector<double> before;
+    for (auto& stage : stages) {
+        loading.push_back(Result{ stage.first, {} });
+    }
+    for (int i = 0; i < options.iterations; i++) {
+        before.clear();
+        for (auto& stage : stages) {
+            before.push_back(Metrics::GetTimer(stage.second).GetTotalMilliseconds());
+        }
+        Model* model = Model::Load(options.filename);
+        if (model == NULL) {
+            return;
+        }
+        for (size_t s = 0; s < loading.size(); s++) {
+            loading[s].samples.push_back(Metrics::GetTimer(stages[s].second).GetTotalMilliseconds() - before[s]);
+        }
+        delete model;
+    }
+    results.insert(results.end(), loading.begin(), loading.end());
+}
+
+// One sample per query; the pairs are drawn uniformly from the map with the seed, so every run routes
+// between the same points.
+static void MeasureRouting(const Options& options, Model& model, vector<Result>& results) {
+    double min_lon, min_lat, max_lon, max_lat;
+    model.GetBounds(min_lon, min_lat, max_lon, max_lat);
+    Model::Node extent = model.ProjectCoordinates(max_lon, max_lat);
+    mt19937 generator(options.seed);
+    uniform_real_distribution<double> x(0., extent.x);
+    uniform_real_distribution<double> y(0., extent.y);
+
+    Result create_route{ "Pathfinder::CreateRoute", {} };
+    AppData data{};
+    for (int i = 0; i < options.queries; i++) {
+        data.start.x = x(generator);
+        data.start.y = y(generator);
+        data.end.x = x(generator);
+        data.end.y = y(generator);
+        Pathfinder pathfinder(&model, &data);
+        auto start_time = chrono::steady_clock::now();
+        pathfinder.CreateRoute();
+        create_route.samples.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count());
+    }
+    results.push_back(create_route);
+}
+
+static void MeasureRendering(const Options& options, Model& model, vector<Result>& results) {
+    Renderer renderer(&model);
+    int width = (int)(600 * model.GetAspectRatio());
+    int height = 600;
+    // The first frame also builds the paths of the view.
+    renderer.MeasureFrameTime(width, height, 1);
+    Result display{ "Renderer::Display", {} };
+    for (int i = 0; i < options.iterations; i++) {
+        display.samples.push_back(renderer.MeasureFrameTime(width, height, 1));
+    }
+    results.push_back(display);
+}
+
+static double Percentile(vector<double> samples, double percentile) {
+    sort(samples.begin(), samples.end());
+    return samples[min(samples.size() - 1, (size_t)(percentile / 100. * samples.size()))];
+}
+
+static void WriteResults(const Options& options, const vector<Result>& results, ostream& stream) {
+    stream << fixed << setprecision(4);
+    stream << "{\"fixture\":\"" << options.filename << "\",\"iterations\":" << options.iterations << ",\"queries\":" << options.queries
+        << ",\"seed\":" << options.seed << ",\"unit\":\"ms\",\"benchmarks\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& samples = results[i].samples;
+        double total = 0.;
+        for (double sample : samples) {
+            total += sample;
+        }
+        stream << (i > 0 ? "," : "") << "\n{\"name\":\"" << results[i].name << "\",\"samples\":" << samples.size()
+            << ",\"mean\":" << total / samples.size() << ",\"min\":" << *min_element(samples.begin(), samples.end())
+            << ",\"p50\":" << Percentile(samples, 50.) << ",\"p90\":" << Percentile(samples, 90.)
+            << ",\"max\":" << *max_element(samples.begin(), samples.end()) << "}";
+    }
+    stream << "\n]}" << endl;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        cout << "usage: benchmarks [-f stockholm.osm] [-iterations 10] [-queries 100] [-seed 1] [-output benchmarks.json]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<Result> results;
+    MeasureLoading(options, results);
+    Model* model = Model::Load(options.filename);
+    if (results.empty() || model == NULL) {
+        cout << "Error: The map '" << options.filename << "' could not be loaded." << endl;
+        return EXIT_FAILURE;
+    }
+    MeasureRouting(options, *model, results);
+    MeasureRendering(options, *model, results);
+    delete model;
+
+    ofstream output(options.output);
+    if (!output) {
+        cout << "Error opening file '" << options.output << "'." << endl;
+        return EXIT_FAILURE;
+    }
+    WriteResults(options, results, output);
+    cout << endl;
+    for (auto& result : results) {
+        cout << left << setw(28) << result.name << right << fixed << setprecision(3) << setw(12) << Percentile(result.samples, 50.) << " ms (p50)" << endl;
+    }
+    cout << "Results written to '" << options.output << "'." << endl;
+    return EXIT_SUCCESS;
+}
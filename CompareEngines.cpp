@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "ArgumentParser.h"
+#include "Helper.h"
+#include "Logger.h"
+#include "Model.h"
+#include "Pathfinder.h"
+#include "RoadGraph.h"
+
+using namespace std;
+using namespace route_app;
+
+// Checks the routing engines against a plain Dijkstra oracle. The oracle keeps its own adjacency lists,
+// built straight from the model's roads, and shares no code with the engines. On every map, random pairs
+// of road nodes are routed by the oracle and by each engine; an engine fails when it finds no route where
+// the oracle does (or the other way round), or when its route cost differs by more than the tolerance.
+// The time of every engine is compared with the oracle's on the same pairs. Any engine added to
+// Pathfinder or RoadGraph should be listed in Engines() so that it is checked before it is turned on.
+// The exit code is non-zero if any engine failed.
+//
+// usage: CompareEngines [-f stockholm.osm]... [-pairs 1000] [-pathfinder_pairs 20] [-seed 1] [-tolerance 1e-9] [-output engines.json]
+
+struct Options {
+    vector<string> filenames;
+    int pairs = 1000;
+    int pathfinder_pairs = 20;
+    unsigned int seed = 1;
+    double tolerance = 1e-9;
+    string output;
+};
+
+// An engine answers a route query between two model node numbers with the route's cost in meters.
+struct Engine {
+    string name;
+    int max_pairs;
+    function<bool(int from, int to, double& cost)> find_route;
+};
+
+struct EngineResult {
+    string map;
+    string engine;
+    int pairs = 0;
+    int failures = 0;
+    double max_error = 0.;
+    double milliseconds = 0.;
+    double oracle_milliseconds = 0.;
+};
+
+static const double UNREACHABLE = numeric_limits<double>::infinity();
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    bool parsed = ArgumentParser::ParseOptionPairs(argc, argv, [&options](const string& name, const string& value) {
+        if (name == "-f") options.filenames.push_back(value);
+        else if (name == "-pairs") options.pairs = max(1, stoi(value));
+        else if (name == "-pathfinder_pairs") options.pathfinder_pairs = max(0, stoi(value));
+        else if (name == "-seed") options.seed = (unsigned int)stoul(value);
+        else if (name == "-tolerance") options.tolerance = stod(value);
+        else if (name == "-output") options.output = value;
+        else return false;
+        return true;
+    });
+    if (options.filenames.empty()) {
+        options.filenames.push_back("stockholm.osm");
+    }
+    return parsed;
+}
+
+// Textbook Dijkstra over adjacency lists indexed by model node number, stopped when the goal is settled.
+class Oracle {
+private:
+    vector<vector<pair<int, double>>> edges_;
+    vector<int> road_nodes_;
+public:
+    explicit Oracle(const Model& model) : edges_(model.GetNodes().size()) {
+        const auto& nodes = model.GetNodes();
+        for (const auto& road : model.GetRoads()) {
+            if (road.type == Model::Road::Invalid) {
+                continue;
+            }
+            const auto& way_nodes = model.GetWays()[road.way].nodes;
+            for (size_t i = 1; i < way_nodes.size(); i++) {
+                int a = way_nodes[i - 1], b = way_nodes[i];
+                double length = hypot(nodes[a].x - nodes[b].x, nodes[a].y - nodes[b].y) * model.GetMetricScale();
+                edges_[a].emplace_back(b, length);
+                edges_[b].emplace_back(a, length);
+            }
+        }
+        for (int node = 0; node < (int)edges_.size(); node++) {
+            if (!edges_[node].empty()) {
+                road_nodes_.push_back(node);
+            }
+        }
+    }
+
+    const vector<int>& GetRoadNodes() const { return road_nodes_; }
+
+    bool FindRoute(int from, int to, double& cost) const {
+        vector<double> distances(edges_.size(), UNREACHABLE);
+        priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> queue;
+        distances[from] = 0.;
+        queue.emplace(0., from);
+        while (!queue.empty()) {
+            auto [distance, node] = queue.top();
+            queue.pop();
+            if (node == to) {
+                cost = distance;
+                return true;
+            }
+            if (distance > distances[node]) {
+                continue;
+            }
+            for (auto [neighbour, length] : edges_[node]) {
+                if (distance + length < distances[neighbour]) {
+                    distances[neighbour] = distance + length;
+                    queue.emplace(distances[neighbour], neighbour);
+                }
+            }
+        }
+        return false;
+    }
+};
+
+static bool SamePosition(const Model& model, int node, int other) {
+    const auto& nodes = model.GetNodes();
+    return nodes[node].x == nodes[other].x && nodes[node].y == nodes[other].y;
+}
+
+// Sums the segments of a route given as model node numbers.
+static double RouteCost(const Model& model, const vector<int>& route) {
+    const auto& nodes = model.GetNodes();
+    double cost = 0.;
+    for (size_t i = 1; i < route.size(); i++) {
+        cost += hypot(nodes[route[i]].x - nodes[route[i - 1]].x, nodes[route[i]].y - nodes[route[i - 1]].y);
+    }
+    return cost * model.GetMetricScale();
+}
+
+static vector<Engine> Engines(const Options& options, Model& model, const RoadGraph& graph) {
+    vector<Engine> engines;
+    engines.push_back({ "RoadGraph::FindRoute", options.pairs, [&graph](int from, int to, double& cost) {
+        RoadGraph::Route route;
+        bool found = graph.FindRoute(from, to, route);
+        cost = route.distance;
+        return found;
+    } });
+    engines.push_back({ "RoadGraph::FindDistances", options.pairs, [&graph](int from, int to, double& cost) {
+        cost = graph.FindDistances(from, { to })[0];
+        return cost != UNREACHABLE;
+    } });
+    // Pathfinder snaps points to road nodes, so it is given the nodes' own coordinates; of several nodes
+    // at one position it may pick another, hence the positions are compared. Its route runs from the goal
+    // back to the start; without a route it only holds the snapped start and goal.
+    engines.push_back({ "Pathfinder::CreateRoute", options.pathfinder_pairs, [&model](int from, int to, double& cost) {
+        AppData data{};
+        data.start = model.GetNodes()[from];
+        data.end = model.GetNodes()[to];
+        model.GetRoute().nodes.clear();
+        Pathfinder pathfinder(&model, &data);
+        pathfinder.CreateRoute();
+        auto& route = model.GetRoute().nodes;
+        bool found = route.size() >= 2 && SamePosition(model, route.front(), to) && SamePosition(model, route.back(), from);
+        cost = found ? RouteCost(model, route) : UNREACHABLE;
+        return found;
+    } });
+    return engines;
+}
+
+static void CompareEngines(const Options& options, const string& map, Model& model, vector<EngineResult>& results) {
+    Oracle oracle(model);
+    RoadGraph graph(model);
+    const auto& road_nodes = oracle.GetRoadNodes();
+    if (road_nodes.size() < 2) {
+        return;
+    }
+    mt19937 generator(options.seed);
+    uniform_int_distribution<size_t> pick(0, road_nodes.size() - 1);
+    vector<pair<int, int>> pairs;
+    vector<bool> oracle_found;
+    vector<double> oracle_costs, oracle_times;
+    while ((int)pairs.size() < options.pairs) {
+        int from = road_nodes[pick(generator)], to = road_nodes[pick(generator)];
+        if (SamePosition(model, from, to)) {
+            continue;
+        }
+        double cost = UNREACHABLE;
+        auto start_time = chrono::steady_clock::now();
+        bool found = oracle.FindRoute(from, to, cost);
+        oracle_times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count());
+        pairs.emplace_back(from, to);
+        oracle_found.push_back(found);
+        oracle_costs.push_back(cost);
+    }
+
+    for (auto& engine : Engines(options, model, graph)) {
+        EngineResult result{ map, engine.name };
+        for (int i = 0; i < min(engine.max_pairs, (int)pairs.size()); i++) {
+            double cost = UNREACHABLE;
+            auto start_time = chrono::steady_clock::now();
+            bool found = engine.find_route(pairs[i].first, pairs[i].second, cost);
+            result.milliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count();
+            result.oracle_milliseconds += oracle_times[i];
+            result.pairs++;
+            double error = found && oracle_found[i] ? fabs(cost - oracle_costs[i]) / max(1., oracle_costs[i]) : 0.;
+            result.max_error = max(result.max_error, error);
+            if (found != oracle_found[i] || error > options.tolerance) {
+                if (result.failures++ == 0) {
+                    cout << fixed << setprecision(3) << map << ": " << engine.name << " routes node " << pairs[i].first << " to node " << pairs[i].second
+                        << " at " << (found ? to_string(cost) + " m" : "no route") << ", the oracle at "
+                        << (oracle_found[i] ? to_string(oracle_costs[i]) + " m" : "no route") << "." << endl;
+                }
+            }
+        }
+        results.push_back(result);
+    }
+}
+
+static void WriteResults(const Options& options, const vector<EngineResult>& results, ostream& stream) {
+    stream << "{\"pairs\":" << options.pairs << ",\"seed\":" << options.seed << ",\"tolerance\":" << options.tolerance << ",\"engines\":[";
+    stream << fixed << setprecision(4);
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& result = results[i];
+        stream << (i > 0 ? "," : "") << "\n{\"map\":\"" << result.map << "\",\"engine\":\"" << result.engine << "\",\"pairs\":" << result.pairs
+            << ",\"failures\":" << result.failures << ",\"max_relative_error\":" << scientific << result.max_error << fixed
+            << ",\"mean_ms\":" << result.milliseconds / max(1, result.pairs) << ",\"oracle_mean_ms\":" << result.oracle_milliseconds / max(1, result.pairs)
+            << ",\"speedup\":" << result.oracle_milliseconds / max(result.milliseconds, 1e-9) << "}";
+    }
+    stream << "\n]}" << endl;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        cout << "usage: CompareEngines [-f stockholm.osm]... [-pairs 1000] [-pathfinder_pairs 20] [-seed 1] [-tolerance 1e-9] [-output engines.json]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<EngineResult> results;
+    for (auto& filename : options.filenames) {
+        Model* model = Model::Load(filename);
+        if (model == NULL) {
+            cout << "Error: The map '" << filename << "' could not be loaded." << endl;
+            return EXIT_FAILURE;
+        }
+        Logger::Flush();
+        CompareEngines(options, filename, *model, results);
+        delete model;
+    }
+
+    Logger::Flush();
+    bool failed = false;
+    cout << endl;
+    for (auto& result : results) {
+        cout << left << setw(24) << result.map << setw(28) << result.engine << right << setw(6) << result.pairs << " pairs"
+            << setw(6) << result.failures << " failed" << fixed << setprecision(3)
+            << setw(12) << result.milliseconds / max(1, result.pairs) << " ms" << setw(10) << result.oracle_milliseconds / max(result.milliseconds, 1e-9) << "x oracle" << endl;
+        failed |= result.failures > 0;
+    }
+    if (!options.output.empty()) {
+        ofstream output(options.output);
+        if (!output) {
+            cout << "Error opening file '" << options.output << "'." << endl;
+            return EXIT_FAILURE;
+        }
+        WriteResults(options, results, output);
+        cout << "Results written to '" << options.output << "'." << endl;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
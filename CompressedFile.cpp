@@ -0,0 +1,128 @@
+#include <zlib.h>
+#include <bzlib.h>
+#include "CompressedFile.h"
+#include "OSMStream.h"
+#include "Helper.h"
+#include "Logger.h"
+
+using namespace route_app;
+
+static const size_t CHUNK_SIZE = 1 << 16;
+
+static bool EndsWith(const string& text, const string& suffix) {
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+CompressedFile::Format CompressedFile::FormatFromFilename(const string& filename) {
+	if (EndsWith(filename, ".gz")) {
+		return Format::GZIP;
+	}
+	if (EndsWith(filename, ".bz2")) {
+		return Format::BZIP2;
+	}
+	return Format::NONE;
+}
+
+bool CompressedFile::IsCompressed(const string& filename) {
+	return FormatFromFilename(filename) != Format::NONE;
+}
+
+// Decompresses the file into the stream and closes it; meant to run on its own thread while the model
+// parses the stream. The stream holds back the decompression while the parser is behind, and stops it
+// when the parser cancels the stream.
+bool CompressedFile::Decompress(const string& filename, OSMStream* stream) {
+	bool success = Read(filename, [stream](const char* data, size_t size) { return stream->Write(data, size); });
+	stream->Close(success);
+	return success;
+}
+
+bool CompressedFile::ReadAll(const string& filename, vector<char>& buffer) {
+	buffer.clear();
+	return Read(filename, [&buffer](const char* data, size_t size) {
+		buffer.insert(buffer.end(), data, data + size);
+		return true;
+	});
+}
+
+// The consumer returns false to stop reading, which fails the read without an error message.
+bool CompressedFile::Read(const string& filename, const function<bool(const char*, size_t)>& consumer) {
+	switch (FormatFromFilename(filename)) {
+	case Format::GZIP:
+		return ReadGzip(filename, consumer);
+	case Format::BZIP2:
+		return ReadBzip2(filename, consumer);
+	default:
+		LOG_ERROR("CompressedFile", "Error: '{}' is not a compressed file.", filename);
+		return false;
+	}
+}
+
+bool CompressedFile::ReadGzip(const string& filename, const function<bool(const char*, size_t)>& consumer) {
+	gzFile file = gzopen(filename.c_str(), "rb");
+	if (file == NULL) {
+		LOG_ERROR("CompressedFile", "Error opening file '{}'.", filename);
+		return false;
+	}
+	gzbuffer(file, CHUNK_SIZE);
+
+	vector<char> chunk(CHUNK_SIZE);
+	int read;
+	while ((read = gzread(file, chunk.data(), (unsigned int)chunk.size())) > 0) {
+		if (!consumer(chunk.data(), (size_t)read)) {
+			gzclose(file);
+			return false;
+		}
+	}
+	bool success = read == 0;
+	if (!success) {
+		int error;
+		LOG_ERROR("CompressedFile", "Error decompressing '{}': {}", filename, gzerror(file, &error));
+	}
+	gzclose(file);
+	return success;
+}
+
+bool CompressedFile::ReadBzip2(const string& filename, const function<bool(const char*, size_t)>& consumer) {
+	FILE* file;
+	_set_errno(0);
+	if (fopen_s(&file, filename.c_str(), "rb") != 0) {
+		LOG_ERROR("CompressedFile", "Error opening file '{}'.", filename);
+		return false;
+	}
+
+	int error;
+	BZFILE* bz_file = BZ2_bzReadOpen(&error, file, 0, 0, NULL, 0);
+	vector<char> chunk(CHUNK_SIZE);
+	while (error == BZ_OK) {
+		int read = BZ2_bzRead(&error, bz_file, chunk.data(), (int)chunk.size());
+		if ((error == BZ_OK || error == BZ_STREAM_END) && read > 0 && !consumer(chunk.data(), (size_t)read)) {
+			BZ2_bzReadClose(&error, bz_file);
+			fclose(file);
+			return false;
+		}
+		// Files written by parallel compressors (e.g. lbzip2) hold several concatenated streams.
+		if (error == BZ_STREAM_END) {
+			void* unused;
+			int unused_size;
+			BZ2_bzReadGetUnused(&error, bz_file, &unused, &unused_size);
+			int next = unused_size == 0 ? fgetc(file) : 0;
+			if (next == EOF) {
+				error = BZ_STREAM_END;
+				break;
+			}
+			if (unused_size == 0) {
+				ungetc(next, file);
+			}
+			vector<char> remaining((char*)unused, (char*)unused + unused_size);
+			BZ2_bzReadClose(&error, bz_file);
+			bz_file = BZ2_bzReadOpen(&error, file, 0, 0, remaining.data(), (int)remaining.size());
+		}
+	}
+	bool success = error == BZ_STREAM_END;
+	if (!success) {
+		LOG_ERROR("CompressedFile", "Error decompressing '{}', bzip2 error code is '{}'.", filename, error);
+	}
+	BZ2_bzReadClose(&error, bz_file);
+	fclose(file);
+	return success;
+}
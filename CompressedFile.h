@@ -0,0 +1,33 @@
+#pragma once
+#ifndef ROUTE_APP_COMPRESSED_FILE_H
+#define ROUTE_APP_COMPRESSED_FILE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace route_app {
+	class OSMStream;
+
+	// Reads gzip (.gz) and bzip2 (.bz2) compressed OSM files chunk by chunk, so the uncompressed data
+	// never has to be written to disk.
+	class CompressedFile {
+	public:
+		enum class Format {
+			NONE, GZIP, BZIP2
+		};
+
+		static Format FormatFromFilename(const string& filename);
+		static bool IsCompressed(const string& filename);
+		static bool Decompress(const string& filename, OSMStream* stream);
+		static bool ReadAll(const string& filename, vector<char>& buffer);
+	private:
+		static bool Read(const string& filename, const function<bool(const char*, size_t)>& consumer);
+		static bool ReadGzip(const string& filename, const function<bool(const char*, size_t)>& consumer);
+		static bool ReadBzip2(const string& filename, const function<bool(const char*, size_t)>& consumer);
+	};
+}
+
+#endif
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include "DistanceMatrix.h"
+#include "Helper.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+
+using namespace route_app;
+
+static const char BINARY_MAGIC[4] = { 'R', 'A', 'D', 'M' };
+
+DistanceMatrix::DistanceMatrix(const RoadGraph& graph, const vector<int>& sources, const vector<int>& targets) : graph_(graph) {
+	sources_ = sources;
+	targets_ = targets;
+}
+
+// Each worker takes the next source until all rows are done; a row is written by one worker only.
+void DistanceMatrix::Compute(size_t thread_count) {
+	METRICS_SCOPE("distance_matrix.compute");
+	auto start_time = chrono::steady_clock::now();
+	distances_.assign(sources_.size() * targets_.size(), 0.);
+	atomic<size_t> next_row{ 0 };
+	thread_count = std::max<size_t>(1, std::min(thread_count, sources_.size()));
+	{
+		ThreadPool pool(thread_count);
+		for (size_t i = 0; i < pool.GetThreadCount(); i++) {
+			pool.Submit([this, &next_row]() {
+				for (size_t row = next_row++; row < sources_.size(); row = next_row++) {
+					vector<double> distances = graph_.FindDistances(sources_[row], targets_);
+					copy(distances.begin(), distances.end(), distances_.begin() + row * targets_.size());
+				}
+			});
+		}
+	}
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+	LOG_INFO("DistanceMatrix", "{}x{} distance matrix computed in {} ms on {} threads.", sources_.size(), targets_.size(), elapsed.count(), thread_count);
+}
+
+// Writes CSV for filenames ending in ".csv" and the binary format otherwise.
+bool DistanceMatrix::Write(const string& filename) const {
+	bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+	if (!(csv ? WriteCsv(filename) : WriteBinary(filename))) {
+		LOG_ERROR("DistanceMatrix", "Error opening file '{}'.", filename);
+		return false;
+	}
+	LOG_INFO("DistanceMatrix", "Distance matrix written to '{}'.", filename);
+	return true;
+}
+
+// One line per source with the distances to the targets in meters; unreachable targets are left empty.
+bool DistanceMatrix::WriteCsv(const string& filename) const {
+	ofstream file(filename);
+	if (!file) {
+		return false;
+	}
+	file << fixed << setprecision(1);
+	for (size_t source = 0; source < sources_.size(); source++) {
+		for (size_t target = 0; target < targets_.size(); target++) {
+			if (target > 0) {
+				file << ',';
+			}
+			if (isfinite(Get(source, target))) {
+				file << Get(source, target);
+			}
+		}
+		file << '\n';
+	}
+	return bool(file);
+}
+
+// "RADM", the number of rows and of columns as 32-bit integers, then the distances row by row as 64-bit
+// doubles, infinite where unreachable; all little-endian.
+bool DistanceMatrix::WriteBinary(const string& filename) const {
+	ofstream file(filename, ios::binary);
+	if (!file) {
+		return false;
+	}
+	uint32_t rows = (uint32_t)sources_.size();
+	uint32_t columns = (uint32_t)targets_.size();
+	file.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+	file.write((const char*)&rows, sizeof(rows));
+	file.write((const char*)&columns, sizeof(columns));
+	file.write((const char*)distances_.data(), distances_.size() * sizeof(double));
+	return bool(file);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef ROUTE_APP_DISTANCE_MATRIX_H
+#define ROUTE_APP_DISTANCE_MATRIX_H
+
+#include <string>
+#include <vector>
+#include "RoadGraph.h"
+
+using namespace std;
+
+namespace route_app {
+
+	// Road distances in meters from every source to every target, e.g. between depots and stops. Each row
+	// is one one-to-many Dijkstra search (RoadGraph::FindDistances) that stops once all targets are settled,
+	// instead of one search per pair; the rows are computed in parallel on a thread pool. Sources and
+	// targets are model node numbers, and unreachable pairs are infinite.
+	class DistanceMatrix {
+	private:
+		const RoadGraph& graph_;
+		vector<int> sources_;
+		vector<int> targets_;
+		vector<double> distances_;
+
+		bool WriteCsv(const string& filename) const;
+		bool WriteBinary(const string& filename) const;
+	public:
+		DistanceMatrix(const RoadGraph& graph, const vector<int>& sources, const vector<int>& targets);
+		void Compute(size_t thread_count);
+		double Get(size_t source, size_t target) const { return distances_[source * targets_.size() + target]; }
+		size_t GetSourceCount() const { return sources_.size(); }
+		size_t GetTargetCount() const { return targets_.size(); }
+		bool Write(const string& filename) const;
+	};
+}
+
+#endif
@@ -1,6 +1,11 @@
 #include <iostream>
+#include <algorithm>
+#include <cctype>
 #include <curl/curl.h>
 #include "HTTPHandler.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "OSMStream.h"
 
 using namespace route_app;
 
@@ -11,7 +16,7 @@ size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp)
 
     char* ptr = (char*)realloc(mem->memory, mem->size + realsize + 1);
     if (ptr == NULL) {
-        PrintDebugMessage(APPLICATION_NAME, "HTTPHandler", "Error: Not enough memory (realloc returned NULL).", false);
+        LOG_ERROR("HTTPHandler", "Error: Not enough memory (realloc returned NULL).");
         return 0;
     }
 
@@ -24,6 +29,46 @@ size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp)
     return realsize;
 }
 
+// Blocks while the parser is behind; returning 0 once the parser has cancelled the stream aborts the transfer.
+size_t stream_callback(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    size_t realsize = size * nmemb;
+    OSMStream* stream = (OSMStream*)userp;
+    return stream->Write((const char*)contents, realsize) ? realsize : 0;
+}
+
+size_t buffer_callback(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    size_t realsize = size * nmemb;
+    vector<char>* buffer = (vector<char>*)userp;
+    buffer->insert(buffer->end(), (char*)contents, (char*)contents + realsize);
+    return realsize;
+}
+
+// Collects the validators (ETag and Last-Modified) of a response into the HTTPResponse passed as userp.
+size_t HTTPHandler::HeaderCallback(char* contents, size_t size, size_t nmemb, void* userp)
+{
+    size_t realsize = size * nmemb;
+    HTTPResponse* response = (HTTPResponse*)userp;
+    string header(contents, realsize);
+    auto separator = header.find(':');
+    if (separator == string::npos) {
+        return realsize;
+    }
+    string name = header.substr(0, separator);
+    transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
+    string value = header.substr(separator + 1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+    if (name == "etag") {
+        response->etag = value;
+    }
+    else if (name == "last-modified") {
+        response->last_modified = value;
+    }
+    return realsize;
+}
+
 HTTPHandler::HTTPHandler(string url, string api, string arguments) {
 	query_ = url + api + arguments;
 	Initialize();
@@ -34,13 +79,22 @@ HTTPHandler::~HTTPHandler() {
 }
 
 void HTTPHandler::Initialize() {
-	curl_global_init(CURL_GLOBAL_ALL);
-	PrintDebugMessage(APPLICATION_NAME, "HTTPHandler", "HTTP Request Handler initialized.", false);
-	PrintDebugMessage(APPLICATION_NAME, "HTTPHandler", "HTTP Request Query: " + query_, false);
+	LOG_DEBUG("HTTPHandler", "HTTP Request Handler initialized.");
+	LOG_INFO("HTTPHandler", "HTTP Request Query: {}", query_);
+}
+
+// Adds the size of a finished transfer to the downloaded bytes metric.
+static void CountDownloadedBytes(CURL* curl_handle) {
+#ifdef ROUTE_APP_METRICS
+    curl_off_t bytes = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    METRICS_COUNT("http.bytes_downloaded", bytes);
+#endif
 }
 
 CURLcode HTTPHandler::Request(AppData *data) {
-    PrintDebugMessage(APPLICATION_NAME, "HTTPHandler", "Initiating HTTP request...", false);
+    METRICS_SCOPE("http.request");
+    LOG_INFO("HTTPHandler", "Initiating HTTP request...");
     CURL* curl_handle;
     CURLcode res{};
     curl_handle = curl_easy_init();
@@ -48,6 +102,8 @@ CURLcode HTTPHandler::Request(AppData *data) {
     curl_easy_setopt(curl_handle, CURLOPT_URL, &(query_[0]));
     curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
     curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 0);
+    // An empty string offers every encoding libcurl supports; the body is decompressed before it reaches the callbacks.
+    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
     switch (data->sm) {
     case StorageMethod::MEMORY_STORAGE:
         curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_callback);
@@ -56,15 +112,75 @@ CURLcode HTTPHandler::Request(AppData *data) {
     case StorageMethod::FILE_STORAGE:
         curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, data->query_file->file);
         break;
+    case StorageMethod::STREAM_STORAGE:
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, stream_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)data->osm_stream);
+        break;
+    default:
+        break;
     }
 
     res = curl_easy_perform(curl_handle);
+    CountDownloadedBytes(curl_handle);
     curl_easy_cleanup(curl_handle);
+
+    if (data->sm == StorageMethod::STREAM_STORAGE) {
+        data->osm_stream->Close(res == CURLE_OK);
+    }
     
     return res;
 }
 
+// Downloads the query into response.body. When a cached copy's validators are given, the request is
+// conditional and a 304 status with an empty body means the cached copy is still current.
+CURLcode HTTPHandler::Fetch(const string& etag, const string& last_modified, HTTPResponse& response) {
+    METRICS_SCOPE("http.fetch");
+    LOG_INFO("HTTPHandler", etag.empty() && last_modified.empty() ? "Initiating HTTP request..." : "Initiating conditional HTTP request...");
+    CURL* curl_handle = curl_easy_init();
+    curl_slist* headers = NULL;
+    if (!etag.empty()) {
+        headers = curl_slist_append(headers, ("If-None-Match: " + etag).c_str());
+    }
+    if (!last_modified.empty()) {
+        headers = curl_slist_append(headers, ("If-Modified-Since: " + last_modified).c_str());
+    }
+
+    curl_easy_setopt(curl_handle, CURLOPT_URL, &(query_[0]));
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 0);
+    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, buffer_callback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&response.body);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void*)&response);
+
+    CURLcode res = curl_easy_perform(curl_handle);
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response.status);
+    CountDownloadedBytes(curl_handle);
+    curl_easy_cleanup(curl_handle);
+    curl_slist_free_all(headers);
+    return res;
+}
+
+// Hands data that was not downloaded by Request (e.g. a cached copy) to the storage selected in data.
+void HTTPHandler::Deliver(AppData* data, const vector<char>& bytes) {
+    switch (data->sm) {
+    case StorageMethod::MEMORY_STORAGE:
+        write_callback((void*)bytes.data(), 1, bytes.size(), (void*)data->query_data);
+        break;
+    case StorageMethod::FILE_STORAGE:
+        fwrite(bytes.data(), 1, bytes.size(), data->query_file->file);
+        break;
+    case StorageMethod::STREAM_STORAGE:
+        data->osm_stream->Write(bytes.data(), bytes.size());
+        data->osm_stream->Close(true);
+        break;
+    default:
+        break;
+    }
+}
+
 void HTTPHandler::Release() {
-    PrintDebugMessage(APPLICATION_NAME, "HTTPHandler", "Releasing resources...", false);
-	curl_global_cleanup();
+    LOG_DEBUG("HTTPHandler", "Releasing resources...");
 }
\ No newline at end of file
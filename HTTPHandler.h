@@ -9,6 +9,13 @@ using namespace std;
 
 namespace route_app {
 
+	struct HTTPResponse {
+		long status = 0;
+		string etag;
+		string last_modified;
+		vector<char> body;
+	};
+
 	class HTTPHandler {
 	private:
 		string query_;
@@ -18,6 +25,9 @@ namespace route_app {
 		HTTPHandler(string url, string api, string arguments);
 		~HTTPHandler();
 		CURLcode Request(AppData *data);
+		CURLcode Fetch(const string& etag, const string& last_modified, HTTPResponse& response);
+		static void Deliver(AppData* data, const vector<char>& bytes);
+		static size_t HeaderCallback(char* contents, size_t size, size_t nmemb, void* userp);
 	};
 }
 
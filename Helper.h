@@ -3,16 +3,18 @@
 #define ROUTE_APP_HELPER_H
 
 #include <iostream>
+#include <vector>
 #include "Model.h"
 
 using namespace std;
 namespace route_app {
     class Model;
+    class OSMStream;
 
     static const string APPLICATION_NAME = "RouteApplication";
 
     enum class StorageMethod {
-        MEMORY_STORAGE, FILE_STORAGE
+        MEMORY_STORAGE, FILE_STORAGE, STREAM_STORAGE, TILE_STORAGE
     };
 
     struct QueryData {
@@ -26,14 +28,22 @@ namespace route_app {
         string filename;
     };
 
+    struct QueryTile {
+        string filename;
+        vector<char> buffer;
+    };
+
     struct AppData {
         StorageMethod sm;
         QueryData* query_data;
         QueryFile* query_file;
+        OSMStream* osm_stream;
+        vector<QueryTile> tiles;
         Model::Node point;
         Model::Node start;
         Model::Node end;
         bool use_aspect_ratio;
+        unsigned int layers;
     };
 
     static void CloseFile(QueryFile* query_file) {
@@ -49,24 +59,5 @@ namespace route_app {
             throw std::logic_error("The file '" + filename + "' was not closed.\n");
         }
     }
-
-    void inline PrintDebugMessage(string application_name, string system_name, string message, bool newlineAtStart) {
-        string newline = "";
-        string tabs = "";
-
-        if (newlineAtStart) {
-            newline = "\n";
-        }
-
-        if (system_name == "") {
-            tabs = "\t\t";
-        }
-        else {
-          system_name = "::" + system_name;
-          tabs = "\t";
-        }
-
-        cout << newline + APPLICATION_NAME + system_name + tabs + message << endl;
-    }
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <curl/curl.h>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Sends concurrent queries to a running route server (RouteApplication -serve) and reports the
+// throughput and the latency percentiles. The query points are drawn uniformly from the served map's
+// bounds with a fixed seed, so that runs are comparable.
+//
+// usage: LoadGenerator [-url http://127.0.0.1:8080] [-clients 8] [-requests 1000]
+//                      [-query route|nearest|matrix|mixed] [-matrix_size 10] [-seed 1]
+
+struct Options {
+    string url = "http://127.0.0.1:8080";
+    int clients = 8;
+    int requests = 1000;
+    string query = "route";
+    int matrix_size = 10;
+    unsigned int seed = 1;
+};
+
+static size_t string_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    ((string*)userp)->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string name = argv[i];
+        string value = argv[i + 1];
+        try {
+            if (name == "-url") options.url = value;
+            else if (name == "-clients") options.clients = max(1, stoi(value));
+            else if (name == "-requests") options.requests = max(1, stoi(value));
+            else if (name == "-query") options.query = value;
+            else if (name == "-matrix_size") options.matrix_size = max(1, stoi(value));
+            else if (name == "-seed") options.seed = (unsigned int)stoul(value);
+            else return false;
+        }
+        catch (const std::exception&) {
+            cout << "'" << value << "' is not a valid value for '" << name << "'." << endl;
+            return false;
+        }
+    }
+    return argc % 2 == 1 && (options.query == "route" || options.query == "nearest" || options.query == "matrix" || options.query == "mixed");
+}
+
+static bool FetchBounds(const string& url, double bounds[4]) {
+    string body;
+    CURL* curl_handle = curl_easy_init();
+    curl_easy_setopt(curl_handle, CURLOPT_URL, (url + "/info").c_str());
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, string_callback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&body);
+    CURLcode code = curl_easy_perform(curl_handle);
+    curl_easy_cleanup(curl_handle);
+    size_t start = body.find("\"bounds\":[");
+    return code == CURLE_OK && start != string::npos &&
+        sscanf(body.c_str() + start + 10, "%lf,%lf,%lf,%lf", &bounds[0], &bounds[1], &bounds[2], &bounds[3]) == 4;
+}
+
+static vector<string> CreateQueries(const Options& options, const double bounds[4]) {
+    mt19937 generator(options.seed);
+    uniform_real_distribution<double> lon(bounds[0], bounds[2]);
+    uniform_real_distribution<double> lat(bounds[1], bounds[3]);
+    auto point = [&]() {
+        ostringstream stream;
+        stream << fixed << setprecision(6) << lon(generator) << "," << lat(generator);
+        return stream.str();
+    };
+
+    const string kinds[] = { "route", "nearest", "matrix" };
+    vector<string> queries;
+    for (int i = 0; i < options.requests; i++) {
+        string kind = options.query == "mixed" ? kinds[i % 3] : options.query;
+        if (kind == "route") {
+            queries.emplace_back(options.url + "/route?from=" + point() + "&to=" + point());
+        }
+        else if (kind == "nearest") {
+            queries.emplace_back(options.url + "/nearest?point=" + point());
+        }
+        else {
+            string points = point();
+            for (int j = 1; j < options.matrix_size; j++) {
+                points += ";" + point();
+            }
+            queries.emplace_back(options.url + "/matrix?points=" + points);
+        }
+    }
+    return queries;
+}
+
+static double Percentile(const vector<double>& sorted, double percentile) {
+    size_t rank = (size_t)ceil(percentile / 100. * sorted.size());
+    return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        cout << "usage: LoadGenerator [-url http://127.0.0.1:8080] [-clients 8] [-requests 1000] "
+            "[-query route|nearest|matrix|mixed] [-matrix_size 10] [-seed 1]" << endl;
+        return EXIT_FAILURE;
+    }
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    double bounds[4];
+    if (!FetchBounds(options.url, bounds)) {
+        cout << "Error: No route server answered at '" << options.url << "'." << endl;
+        curl_global_cleanup();
+        return EXIT_FAILURE;
+    }
+    vector<string> queries = CreateQueries(options, bounds);
+
+    atomic<int> next_query{ 0 };
+    atomic<int> errors{ 0 };
+    vector<vector<double>> latencies(options.clients);
+    vector<thread> clients;
+    auto start_time = chrono::steady_clock::now();
+    for (int client = 0; client < options.clients; client++) {
+        clients.emplace_back([&, client]() {
+            string body;
+            CURL* curl_handle = curl_easy_init();
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, string_callback);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&body);
+            for (int i = next_query++; i < (int)queries.size(); i = next_query++) {
+                body.clear();
+                curl_easy_setopt(curl_handle, CURLOPT_URL, queries[i].c_str());
+                auto request_start = chrono::steady_clock::now();
+                CURLcode code = curl_easy_perform(curl_handle);
+                latencies[client].emplace_back(chrono::duration<double, milli>(chrono::steady_clock::now() - request_start).count());
+                long status = 0;
+                curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &status);
+                // A 404 is a valid answer, e.g. when two random points are not connected by roads.
+                if (code != CURLE_OK || (status != 200 && status != 404)) {
+                    errors++;
+                }
+            }
+            curl_easy_cleanup(curl_handle);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    curl_global_cleanup();
+
+    vector<double> all;
+    for (const auto& client_latencies : latencies) {
+        all.insert(all.end(), client_latencies.begin(), client_latencies.end());
+    }
+    sort(all.begin(), all.end());
+    cout << fixed << setprecision(2);
+    cout << "Queries:    " << all.size() << " " << options.query << " (" << errors << " errors) from " << options.clients << " clients" << endl;
+    cout << "Throughput: " << all.size() / elapsed << " queries/s" << endl;
+    cout << "Latency:    p50 " << Percentile(all, 50) << " ms, p90 " << Percentile(all, 90) << " ms, p99 "
+        << Percentile(all, 99) << " ms, max " << all.back() << " ms" << endl;
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
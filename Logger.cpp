@@ -0,0 +1,215 @@
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Helper.h"
+#include "Logger.h"
+
+using namespace route_app;
+
+atomic<int> Logger::level_{ (int)Logger::Level::INFO_LEVEL };
+
+namespace {
+	// Bounded multi-producer queue after Dmitry Vyukov: every slot carries a sequence number that tells
+	// producers and the consumer whose turn it is, so producers only contend on one compare-and-swap.
+	const size_t QUEUE_CAPACITY = 4096;
+
+	struct Slot {
+		atomic<size_t> sequence;
+		Logger::Record record;
+	};
+
+	class Writer {
+	public:
+		Writer() : slots_(new Slot[QUEUE_CAPACITY]) {
+			for (size_t i = 0; i < QUEUE_CAPACITY; i++) {
+				slots_[i].sequence.store(i, memory_order_relaxed);
+			}
+			thread_ = thread(&Writer::Run, this);
+		}
+
+		~Writer() {
+			{
+				lock_guard<mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			wake_.notify_one();
+			thread_.join();
+		}
+
+		bool TryPush(const Logger::Record& record) {
+			size_t position = enqueue_position_.load(memory_order_relaxed);
+			while (true) {
+				Slot& slot = slots_[position % QUEUE_CAPACITY];
+				size_t sequence = slot.sequence.load(memory_order_acquire);
+				if (sequence == position) {
+					if (enqueue_position_.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+						slot.record = record;
+						slot.sequence.store(position + 1, memory_order_release);
+						return true;
+					}
+				}
+				else if (sequence < position) {
+					return false;
+				}
+				else {
+					position = enqueue_position_.load(memory_order_relaxed);
+				}
+			}
+		}
+
+		// Blocks until every record pushed before the call has been written and flushed.
+		void Flush() {
+			size_t position = enqueue_position_.load(memory_order_relaxed);
+			unique_lock<mutex> lock(mutex_);
+			flush_requested_ = true;
+			wake_.notify_one();
+			written_.wait(lock, [&] { return written_position_ >= position; });
+		}
+
+		bool SetFile(const string& filename) {
+			auto file = make_unique<ofstream>(filename, ios::app);
+			if (!*file) {
+				return false;
+			}
+			Flush();
+			lock_guard<mutex> lock(mutex_);
+			file_ = std::move(file);
+			return true;
+		}
+
+		atomic<long long> dropped_{ 0 };
+	private:
+		unique_ptr<Slot[]> slots_;
+		atomic<size_t> enqueue_position_{ 0 };
+		size_t dequeue_position_ = 0;
+		mutex mutex_;
+		condition_variable wake_;
+		condition_variable written_;
+		size_t written_position_ = 0;
+		bool flush_requested_ = false;
+		bool stopping_ = false;
+		unique_ptr<ofstream> file_;
+		thread thread_;
+
+		void Run() {
+			string line;
+			long long reported_dropped = 0;
+			unique_lock<mutex> lock(mutex_);
+			while (true) {
+				ostream& output = file_ ? *file_ : cout;
+				bool drained = false;
+				while (!drained) {
+					Slot& slot = slots_[dequeue_position_ % QUEUE_CAPACITY];
+					if (slot.sequence.load(memory_order_acquire) != dequeue_position_ + 1) {
+						drained = true;
+						break;
+					}
+					Format(slot.record, line);
+					slot.sequence.store(dequeue_position_ + QUEUE_CAPACITY, memory_order_release);
+					dequeue_position_++;
+					output << line;
+				}
+				long long dropped = dropped_.load(memory_order_relaxed);
+				if (dropped != reported_dropped) {
+					output << APPLICATION_NAME << "::Logger\tWarning: " << dropped - reported_dropped << " messages were dropped, the queue was full.\n";
+					reported_dropped = dropped;
+				}
+				output.flush();
+				written_position_ = dequeue_position_;
+				flush_requested_ = false;
+				written_.notify_all();
+				if (stopping_ && enqueue_position_.load(memory_order_relaxed) == dequeue_position_) {
+					break;
+				}
+				wake_.wait_for(lock, chrono::milliseconds(5), [&] { return stopping_ || flush_requested_; });
+			}
+		}
+
+		// Replaces each "{}" of the format by the next argument, after the "RouteApplication::System" prefix.
+		static void Format(const Logger::Record& record, string& line) {
+			line = APPLICATION_NAME;
+			if (*record.system == '\0') {
+				line += "\t\t";
+			}
+			else {
+				line += "::";
+				line += record.system;
+				line += '\t';
+			}
+			size_t argument = 0;
+			for (const char* c = record.format; *c != '\0'; c++) {
+				if (c[0] != '{' || c[1] != '}' || argument >= record.argument_count) {
+					line += *c;
+					continue;
+				}
+				auto& value = record.arguments[argument++];
+				char buffer[32];
+				switch (value.type) {
+				case Logger::Argument::Type::SIGNED:
+					snprintf(buffer, sizeof(buffer), "%lld", value.signed_value);
+					line += buffer;
+					break;
+				case Logger::Argument::Type::UNSIGNED:
+					snprintf(buffer, sizeof(buffer), "%llu", value.unsigned_value);
+					line += buffer;
+					break;
+				case Logger::Argument::Type::FLOATING:
+					snprintf(buffer, sizeof(buffer), "%.6g", value.floating_value);
+					line += buffer;
+					break;
+				case Logger::Argument::Type::TEXT:
+					line.append(record.text + value.text.offset, value.text.size);
+					break;
+				}
+				c++;
+			}
+			line += '\n';
+		}
+	};
+
+	Writer& GetWriter() {
+		static Writer writer;
+		return writer;
+	}
+}
+
+void Logger::Push(const Record& record) {
+	Writer& writer = GetWriter();
+	while (!writer.TryPush(record)) {
+		if (record.level < Level::WARNING_LEVEL) {
+			writer.dropped_.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+		this_thread::yield();
+	}
+}
+
+bool Logger::ParseLevel(const string& name, Level& level) {
+	static const pair<const char*, Level> levels[] = {
+		{ "debug", Level::DEBUG_LEVEL }, { "info", Level::INFO_LEVEL }, { "warning", Level::WARNING_LEVEL },
+		{ "error", Level::ERROR_LEVEL }, { "off", Level::OFF_LEVEL }
+	};
+	for (auto& [level_name, value] : levels) {
+		if (name == level_name) {
+			level = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Appends the log to the file instead of writing it to standard output.
+bool Logger::SetFile(const string& filename) {
+	return GetWriter().SetFile(filename);
+}
+
+void Logger::Flush() {
+	GetWriter().Flush();
+}
+
+long long Logger::GetDroppedCount() {
+	return GetWriter().dropped_.load(memory_order_relaxed);
+}
@@ -0,0 +1,152 @@
+#pragma once
+#ifndef ROUTE_APP_LOGGER_H
+#define ROUTE_APP_LOGGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std;
+
+// Messages below ROUTE_APP_LOG_LEVEL (the CMake cache variable of the same name, 0 = debug ... 4 = off) are
+// compiled out. The rest are filtered by Logger::SetLevel before their arguments are evaluated.
+#ifndef ROUTE_APP_LOG_LEVEL
+#define ROUTE_APP_LOG_LEVEL 0
+#endif
+
+#define ROUTE_APP_LOG(level, ...) \
+	do { \
+		if constexpr ((int)(level) >= ROUTE_APP_LOG_LEVEL) { \
+			if (route_app::Logger::IsEnabled(level)) { \
+				route_app::Logger::Log(level, __VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+#define LOG_DEBUG(system, ...) ROUTE_APP_LOG(route_app::Logger::Level::DEBUG_LEVEL, system, __VA_ARGS__)
+#define LOG_INFO(system, ...) ROUTE_APP_LOG(route_app::Logger::Level::INFO_LEVEL, system, __VA_ARGS__)
+#define LOG_WARNING(system, ...) ROUTE_APP_LOG(route_app::Logger::Level::WARNING_LEVEL, system, __VA_ARGS__)
+#define LOG_ERROR(system, ...) ROUTE_APP_LOG(route_app::Logger::Level::ERROR_LEVEL, system, __VA_ARGS__)
+
+namespace route_app {
+
+	// Leveled logging with deferred formatting. A call copies its arguments into a fixed-size record and
+	// pushes it onto a bounded lock-free queue; a background thread formats the records and writes them,
+	// flushing the output only when the queue runs empty. The system name and the format (with "{}" for
+	// each argument) must be string literals, since only their pointers are recorded. When the queue is
+	// full, debug and info messages are dropped and counted, warnings and errors wait for a free slot.
+	class Logger {
+	public:
+		enum class Level {
+			DEBUG_LEVEL, INFO_LEVEL, WARNING_LEVEL, ERROR_LEVEL, OFF_LEVEL
+		};
+
+		static const size_t MAX_ARGUMENTS = 8;
+		static const size_t TEXT_CAPACITY = 256;
+
+		struct Argument {
+			enum class Type : uint8_t {
+				SIGNED, UNSIGNED, FLOATING, TEXT
+			};
+
+			Type type;
+			union {
+				long long signed_value;
+				unsigned long long unsigned_value;
+				double floating_value;
+				struct {
+					uint16_t offset;
+					uint16_t size;
+				} text;
+			};
+		};
+
+		struct Record {
+			Level level;
+			uint8_t argument_count;
+			uint16_t text_size;
+			const char* system;
+			const char* format;
+			Argument arguments[MAX_ARGUMENTS];
+			char text[TEXT_CAPACITY];
+		};
+
+		static bool IsEnabled(Level level) { return (int)level >= level_.load(memory_order_relaxed); }
+		static void SetLevel(Level level) { level_.store((int)level, memory_order_relaxed); }
+		static Level GetLevel() { return (Level)level_.load(memory_order_relaxed); }
+		static bool ParseLevel(const string& name, Level& level);
+		static bool SetFile(const string& filename);
+		static void Flush();
+		static long long GetDroppedCount();
+
+		template <typename... Args>
+		static void Log(Level level, const char* system, const char* format, const Args&... args) {
+			static_assert(sizeof...(Args) <= MAX_ARGUMENTS, "Too many arguments for one log record.");
+			Record record;
+			record.level = level;
+			record.argument_count = 0;
+			record.text_size = 0;
+			record.system = system;
+			record.format = format;
+			(Capture(record, args), ...);
+			Push(record);
+		}
+	private:
+		static atomic<int> level_;
+
+		static void Push(const Record& record);
+
+		template <typename T>
+		static void Capture(Record& record, const T& value) {
+			Argument& argument = record.arguments[record.argument_count++];
+			if constexpr (is_same_v<T, bool>) {
+				CaptureText(record, argument, value ? "true" : "false");
+			}
+			else if constexpr (is_same_v<T, char>) {
+				CaptureText(record, argument, string_view(&value, 1));
+			}
+			else if constexpr (is_integral_v<T> && is_signed_v<T>) {
+				argument.type = Argument::Type::SIGNED;
+				argument.signed_value = value;
+			}
+			else if constexpr (is_integral_v<T>) {
+				argument.type = Argument::Type::UNSIGNED;
+				argument.unsigned_value = value;
+			}
+			else if constexpr (is_enum_v<T>) {
+				argument.type = Argument::Type::SIGNED;
+				argument.signed_value = (long long)value;
+			}
+			else if constexpr (is_floating_point_v<T>) {
+				argument.type = Argument::Type::FLOATING;
+				argument.floating_value = value;
+			}
+			else {
+				CaptureText(record, argument, string_view(value));
+			}
+		}
+
+		template <typename T>
+		static void Capture(Record& record, const atomic<T>& value) {
+			Capture(record, value.load(memory_order_relaxed));
+		}
+
+		// Copies the text into the record, cutting it short with "..." once the record is full.
+		static void CaptureText(Record& record, Argument& argument, string_view text) {
+			size_t size = min(text.size(), TEXT_CAPACITY - record.text_size);
+			memcpy(record.text + record.text_size, text.data(), size);
+			if (size < text.size() && size >= 3) {
+				memcpy(record.text + record.text_size + size - 3, "...", 3);
+			}
+			argument.type = Argument::Type::TEXT;
+			argument.text.offset = record.text_size;
+			argument.text.size = (uint16_t)size;
+			record.text_size += (uint16_t)size;
+		}
+	};
+}
+
+#endif
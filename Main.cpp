@@ -1,9 +1,26 @@
 ﻿#include <io2d.h>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <future>
+#include <sstream>
 #include "Helper.h"
+#include "Logger.h"
 #include "ArgumentParser.h"
 #include "HTTPHandler.h"
+#include "Metrics.h"
+#include "CompressedFile.h"
+#include "DistanceMatrix.h"
+#include "OSMStream.h"
+#include "TileCache.h"
+#include "TileDownloader.h"
+#include "TileRenderer.h"
 #include "Pathfinder.h"
+#include "QueryLog.h"
+#include "RoadGraph.h"
+#include "RouteServer.h"
 #include "Renderer.h"
+#include "TourPlanner.h"
 
 using namespace std;
 namespace io2d = std::experimental::io2d;
@@ -18,14 +35,48 @@ namespace route_app {
         Renderer* renderer_ = NULL;
         ArgumentParser* parser_ = NULL;
         Pathfinder* pathfinder_ = NULL;
+        TileCache* cache_ = NULL;
+        future<CURLcode> download_;
+        future<bool> decompression_;
+        chrono::steady_clock::time_point request_start_;
         string url_;
         string api_;
         string query_prefix_;
         string query_bounds_;
+        string change_filename_;
+        string compare_filename_;
+        string compressed_filename_;
+        string reload_filename_;
+        double tile_size_ = 0.;
+        int parallel_transfers_ = 4;
+        int max_retries_ = 3;
+        int server_port_ = 0;
+        int server_threads_ = 0;
+        string query_log_filename_;
+        string matrix_filename_;
+        string sources_filename_;
+        string targets_filename_;
+        string stops_filename_;
+        string tour_filename_;
+        int tour_budget_ = 500;
+        bool raster_cache_ = false;
+        float view_zoom_ = 1.f;
+        string view_center_;
+        string png_filename_;
+        string batch_filename_;
+        string image_size_;
+        string tile_directory_;
+        string tile_zoom_;
+        int benchmark_frames_ = 0;
+        string metrics_filename_;
+        string trace_filename_;
         bool download_osm_data_;
 
+        void InitializeLogging();
         void InitializeAppData();
         void InitializeStartAndEnd();
+        void InitializeTiles(const string& filenames);
+        bool CompareWithRebuild();
         void Release();
         void Exit(int code);
     public:
@@ -38,32 +89,55 @@ namespace route_app {
         void ReleaseParser();
         void ReleaseHTTPHandler();
         bool HTTPRequest();
+        bool DownloadTiles();
+        bool CachedHTTPRequest();
+        bool CheckHTTPResult(CURLcode code);
         bool ModelData();
-        void FindRoute();
-        void Render();
+        bool FindRoute();
+        bool IsServing() const;
+        Model* LoadModel(const string& filenames);
+        bool Serve();
+        bool Render();
         void DisplayMap();
+        bool InitializeView();
+        bool IsHeadless() const;
+        bool GetImageSize(int& width, int& height) const;
+        bool RenderToFile();
+        bool RenderBatch();
+        bool IsRenderingTiles() const;
+        bool RenderTiles();
+        bool IsComputingMatrix() const;
+        bool ReadPoints(const string& filename, const RoadGraph& graph, vector<int>& node_numbers);
+        bool ComputeMatrix();
+        bool IsPlanningTour() const;
+        bool PlanTour();
+        bool IsBenchmarkingFrames() const;
+        bool CompareFrameTimes();
+        void WriteMetrics();
         const double BOUNDING_BOX_INTERVAL = 0.00166666;
     };
 
     RouteApplication::RouteApplication(int argc, char** argv) {
-        PrintDebugMessage(APPLICATION_NAME, "", "Creating Route Application...", false);
+        LOG_DEBUG("", "Creating Route Application...");
         url_ = "https://api.openstreetmap.org";
         api_ = "/api/0.6";
         query_prefix_ = "/map?bbox=";
         query_bounds_ = "";
         download_osm_data_ = false;
+        curl_global_init(CURL_GLOBAL_ALL);
         cout << std::setprecision(7);
         cout << std::fixed;
     }
 
     bool RouteApplication::ParseCommandLineArguments(int argc, char** argv) {
-        PrintDebugMessage(APPLICATION_NAME, "", "Parsing arguments from command line...", false);
+        LOG_DEBUG("", "Parsing arguments from command line...");
 
         parser_ = new ArgumentParser(argc, argv);
         return parser_->SyntaxAnalysis(argc, argv);
     }
 
     void RouteApplication::Initialize() {
+        InitializeLogging();
         InitializeAppData();
         using S = ArgumentParser::SyntaxFlags;
         if ((parser_->GetSyntaxState() & (int)S::BOUNDS) == (int)S::BOUNDS) {
@@ -80,22 +154,94 @@ namespace route_app {
             query_bounds_ += to_string(data_->point.y + BOUNDING_BOX_INTERVAL);
             download_osm_data_ = true;
         }
+        url_ = parser_->GetOption("-url", url_);
+        tile_size_ = parser_->GetNumericOption("-tile_size", tile_size_);
+        parallel_transfers_ = (int)parser_->GetNumericOption("-parallel", parallel_transfers_);
+        max_retries_ = (int)parser_->GetNumericOption("-retries", max_retries_);
+        if (parser_->HasOption("-cache")) {
+            size_t max_bytes = (size_t)(parser_->GetNumericOption("-cache_size", 512.) * 1024 * 1024);
+            long long max_age = (long long)parser_->GetNumericOption("-cache_max_age", 86400.);
+            cache_ = new TileCache(parser_->GetOption("-cache"), max_bytes, max_age);
+        }
+        server_port_ = (int)parser_->GetNumericOption("-serve", 0.);
+        server_threads_ = (int)parser_->GetNumericOption("-threads", (double)thread::hardware_concurrency());
+        query_log_filename_ = parser_->GetOption("-query_log");
+        matrix_filename_ = parser_->GetOption("-matrix");
+        sources_filename_ = parser_->GetOption("-sources");
+        targets_filename_ = parser_->GetOption("-targets", sources_filename_);
+        stops_filename_ = parser_->GetOption("-stops");
+        tour_filename_ = parser_->GetOption("-tour");
+        tour_budget_ = (int)parser_->GetNumericOption("-tour_budget", tour_budget_);
+        raster_cache_ = parser_->HasOption("-raster_cache");
+        view_zoom_ = (float)parser_->GetNumericOption("-zoom", view_zoom_);
+        view_center_ = parser_->GetOption("-center");
+        png_filename_ = parser_->GetOption("-png");
+        batch_filename_ = parser_->GetOption("-batch");
+        image_size_ = parser_->GetOption("-size");
+        tile_directory_ = parser_->GetOption("-render_tiles");
+        tile_zoom_ = parser_->GetOption("-tile_zoom", "12-16");
+        benchmark_frames_ = (int)parser_->GetNumericOption("-frame_benchmark", 0.);
+        metrics_filename_ = parser_->GetOption("-metrics");
+        trace_filename_ = parser_->GetOption("-trace");
+        if (!metrics_filename_.empty() || !trace_filename_.empty()) {
+            if (!Metrics::IsEnabled()) {
+                LOG_WARNING("", "Warning: This build has no metrics, configure it with -DROUTE_APP_METRICS=ON.");
+            }
+            Metrics::EnableTrace(!trace_filename_.empty());
+        }
+        change_filename_ = parser_->GetOption("-osc");
+        compare_filename_ = parser_->GetOption("-compare");
         ReleaseParser();
     }
 
+    // Applies -log_level and -log_file before anything else is logged.
+    void RouteApplication::InitializeLogging() {
+        string level_name = parser_->GetOption("-log_level");
+        Logger::Level level;
+        if (!level_name.empty()) {
+            if (!Logger::ParseLevel(level_name, level)) {
+                LOG_ERROR("", "Error: Unknown log level '{}', expected debug, info, warning, error or off.", level_name);
+                Exit(EXIT_FAILURE);
+            }
+            Logger::SetLevel(level);
+        }
+        string log_filename = parser_->GetOption("-log_file");
+        if (!log_filename.empty() && !Logger::SetFile(log_filename)) {
+            LOG_ERROR("", "Error opening file '{}'.", log_filename);
+            Exit(EXIT_FAILURE);
+        }
+    }
+
     void RouteApplication::InitializeAppData() {
         data_ = new AppData();
         data_->use_aspect_ratio = true;
+        data_->layers = (unsigned int)Model::LayerFlags::ALL;
         string file_mode;
 
+        if (parser_->HasOption("-layers")) {
+            if (int layers = Model::LayersFromString(parser_->GetOption("-layers")); layers > 0) {
+                data_->layers = layers;
+            }
+            else {
+                LOG_ERROR("", "Error: Unknown layer in '{}'.", parser_->GetOption("-layers"));
+                Exit(EXIT_FAILURE);
+            }
+        }
+
         using S = ArgumentParser::SyntaxFlags;
         switch (parser_->GetSyntaxState()) {
         case (int)S::BOUNDS:
-            data_->sm = StorageMethod::MEMORY_STORAGE;
+            if (parser_->HasOption("-tile_size")) {
+                data_->sm = StorageMethod::TILE_STORAGE;
+            }
+            else {
+                data_->sm = parser_->HasOption("-pipeline") ? StorageMethod::STREAM_STORAGE : StorageMethod::MEMORY_STORAGE;
+            }
             break;
         case (int)S::FILE:
             file_mode = "r";
             data_->sm = StorageMethod::FILE_STORAGE;
+            reload_filename_ = parser_->GetFilename();
             break;
         case (int)S::BOUNDS | (int)S::FILE:
             file_mode = "w";
@@ -104,7 +250,7 @@ namespace route_app {
         case (int)S::POINT:
             data_->point.x = parser_->GetPoint().x;
             data_->point.y = parser_->GetPoint().y;
-            data_->sm = StorageMethod::MEMORY_STORAGE;
+            data_->sm = parser_->HasOption("-pipeline") ? StorageMethod::STREAM_STORAGE : StorageMethod::MEMORY_STORAGE;
             data_->use_aspect_ratio = false;
             break;
         case (int)S::POINT | (int)S::FILE:
@@ -122,6 +268,18 @@ namespace route_app {
 
         InitializeStartAndEnd();
 
+        if (data_->sm == StorageMethod::FILE_STORAGE && file_mode == "r" && parser_->GetFilename().find(',') != string::npos) {
+            InitializeTiles(parser_->GetFilename());
+        }
+        else if (data_->sm == StorageMethod::FILE_STORAGE && CompressedFile::IsCompressed(parser_->GetFilename())) {
+            if (file_mode != "r") {
+                LOG_ERROR("", "Error: Downloaded data can only be saved uncompressed.");
+                Exit(EXIT_FAILURE);
+            }
+            compressed_filename_ = parser_->GetFilename();
+            data_->sm = StorageMethod::STREAM_STORAGE;
+        }
+
         errno_t error;
         switch (data_->sm) {
         case StorageMethod::FILE_STORAGE:
@@ -130,7 +288,7 @@ namespace route_app {
             _set_errno(0);
             error = fopen_s(&data_->query_file->file, data_->query_file->filename.c_str(), file_mode.c_str());
             if (error != 0) {
-                PrintDebugMessage(APPLICATION_NAME, "", "Error opening file '" + data_->query_file->filename + "'.", false);
+                LOG_ERROR("", "Error opening file '{}'.", data_->query_file->filename);
                 Exit(EXIT_FAILURE);
             }
             break;
@@ -140,6 +298,26 @@ namespace route_app {
             data_->query_data->size = 0;
             data_->query_data->callback_count = 0;
             break;
+        case StorageMethod::STREAM_STORAGE:
+            data_->osm_stream = new OSMStream();
+            break;
+        case StorageMethod::TILE_STORAGE:
+            break;
+        }
+    }
+
+    void RouteApplication::InitializeTiles(const string& filenames) {
+        data_->sm = StorageMethod::TILE_STORAGE;
+        size_t start = 0;
+        while (start <= filenames.size()) {
+            size_t separator = filenames.find(',', start);
+            if (separator == string::npos) {
+                separator = filenames.size();
+            }
+            if (separator > start) {
+                data_->tiles.emplace_back().filename = filenames.substr(start, separator - start);
+            }
+            start = separator + 1;
         }
     }
 
@@ -164,62 +342,509 @@ namespace route_app {
     }
 
     bool RouteApplication::HTTPRequest() {
+        METRICS_SCOPE("app.http_request");
+        request_start_ = chrono::steady_clock::now();
+        if (download_osm_data_ && data_->sm == StorageMethod::TILE_STORAGE) {
+            return DownloadTiles();
+        }
+        if (download_osm_data_ && cache_ != NULL) {
+            return CachedHTTPRequest();
+        }
         if (download_osm_data_) {
-            PrintDebugMessage(APPLICATION_NAME, "", "Initializing HTTP request query...", true);
+            LOG_INFO("", "Initializing HTTP request query...");
             handler_ = new HTTPHandler(url_, api_, query_prefix_ + query_bounds_);
+            if (data_->sm == StorageMethod::STREAM_STORAGE) {
+                LOG_INFO("", "Downloading in the background, the model is parsed while data arrives.");
+                download_ = async(launch::async, [this]() { return handler_->Request(data_); });
+                return true;
+            }
             CURLcode code = handler_->Request(data_);
             ReleaseHTTPHandler();
-            if (code == CURLE_OK) {
-                PrintDebugMessage(APPLICATION_NAME, "", "HTTP request successful.", false);
-                return true;
+            return CheckHTTPResult(code);
+        }
+        return true;
+    }
+
+    bool RouteApplication::DownloadTiles() {
+        LOG_INFO("", "Initializing tiled HTTP requests...");
+        double min_lon, min_lat, max_lon, max_lat;
+        if (sscanf(query_bounds_.c_str(), "%lf,%lf,%lf,%lf", &min_lon, &min_lat, &max_lon, &max_lat) != 4 || tile_size_ <= 0.) {
+            LOG_ERROR("", "Error: Invalid bounds or tile size for a tiled download.");
+            return false;
+        }
+        auto bounds = TileDownloader::SplitBounds(min_lon, min_lat, max_lon, max_lat, tile_size_);
+
+        // Fresh cached tiles are used as they are; stale ones are kept and revalidated with a conditional
+        // request, and only replaced when the server sends a new copy.
+        data_->tiles.resize(bounds.size());
+        vector<TileDownloader::Request> requests;
+        vector<TileCache::Entry> stale_entries;
+        vector<size_t> missing_tiles;
+        for (size_t i = 0; i < bounds.size(); i++) {
+            TileCache::Entry entry;
+            string key = TileCache::NormalizeQuery(url_ + api_ + query_prefix_, bounds[i]);
+            bool cached = cache_ != NULL && cache_->Lookup(key, entry) && cache_->Load(entry, data_->tiles[i].buffer);
+            if (cached && cache_->IsFresh(entry)) {
+                cache_->RecordHit(entry, false);
+                continue;
             }
-            else {
-                cout << "Error: HTTP request unsuccessful, CURL error code is '" << code << "'." << endl;
-                return false;
+            if (!cached) {
+                entry = TileCache::Entry{};
+            }
+            requests.push_back({ bounds[i], entry.etag, entry.last_modified });
+            stale_entries.emplace_back(entry);
+            missing_tiles.emplace_back(i);
+        }
+        if (requests.empty()) {
+            LOG_INFO("", "All tiles were found in the cache.");
+            return true;
+        }
+
+        vector<HTTPResponse> responses;
+        TileDownloader downloader(url_, api_, query_prefix_, parallel_transfers_, max_retries_, 500);
+        if (!downloader.Download(requests, responses)) {
+            LOG_ERROR("", "Error: Tiled HTTP requests unsuccessful.");
+            return false;
+        }
+        for (size_t i = 0; i < missing_tiles.size(); i++) {
+            auto& response = responses[i];
+            if (response.status == 304 && cache_ != NULL) {
+                cache_->RecordHit(stale_entries[i], true);
+                continue;
             }
+            if (cache_ != NULL) {
+                cache_->RecordMiss();
+                cache_->Store(TileCache::NormalizeQuery(url_ + api_ + query_prefix_, requests[i].bounds), response.body, response.etag, response.last_modified);
+            }
+            data_->tiles[missing_tiles[i]].buffer = std::move(response.body);
         }
+        LOG_INFO("", "Tiled HTTP requests successful.");
         return true;
     }
 
+    // Serves the query from the cache when the cached copy is fresh, revalidates it with a conditional
+    // request when it is stale, and downloads and caches it otherwise.
+    bool RouteApplication::CachedHTTPRequest() {
+        LOG_INFO("", "Initializing cached HTTP request query...");
+        string key = TileCache::NormalizeQuery(url_ + api_ + query_prefix_, query_bounds_);
+        TileCache::Entry entry;
+        vector<char> bytes;
+        bool cached = cache_->Lookup(key, entry) && cache_->Load(entry, bytes);
+        if (cached && cache_->IsFresh(entry)) {
+            LOG_INFO("", "Cache hit, skipping the HTTP request.");
+            cache_->RecordHit(entry, false);
+            HTTPHandler::Deliver(data_, bytes);
+            return true;
+        }
+
+        handler_ = new HTTPHandler(url_, api_, query_prefix_ + query_bounds_);
+        HTTPResponse response;
+        CURLcode code = cached ? handler_->Fetch(entry.etag, entry.last_modified, response) : handler_->Fetch("", "", response);
+        ReleaseHTTPHandler();
+        if (code != CURLE_OK) {
+            return CheckHTTPResult(code);
+        }
+        if (response.status == 304 && cached) {
+            LOG_INFO("", "The cached copy is still current.");
+            cache_->RecordHit(entry, true);
+            HTTPHandler::Deliver(data_, bytes);
+            return true;
+        }
+        if (response.status == 200) {
+            LOG_INFO("", "HTTP request successful.");
+            cache_->RecordMiss();
+            cache_->Store(key, response.body, response.etag, response.last_modified);
+            HTTPHandler::Deliver(data_, response.body);
+            return true;
+        }
+        LOG_ERROR("", "Error: HTTP request unsuccessful, HTTP status is '{}'.", response.status);
+        return false;
+    }
+
+    bool RouteApplication::CheckHTTPResult(CURLcode code) {
+        if (code == CURLE_OK) {
+            LOG_INFO("", "HTTP request successful.");
+            return true;
+        }
+        else {
+            LOG_ERROR("", "Error: HTTP request unsuccessful, CURL error code is '{}'.", code);
+            return false;
+        }
+    }
+
     bool RouteApplication::ModelData() {
-        PrintDebugMessage(APPLICATION_NAME, "", "Creating model...", true);
+        METRICS_SCOPE("app.model_data");
+        LOG_INFO("", "Creating model...");
+        if (!compressed_filename_.empty()) {
+            LOG_INFO("", "Decompressing '{}' in the background.", compressed_filename_);
+            decompression_ = async(launch::async, CompressedFile::Decompress, compressed_filename_, data_->osm_stream);
+        }
         model_ = new Model(data_);
-        return model_->WasModelCreated();
+        bool created = model_->WasModelCreated();
+        if (decompression_.valid()) {
+            created = decompression_.get() && created;
+        }
+        if (download_.valid()) {
+            created = CheckHTTPResult(download_.get()) && created;
+            ReleaseHTTPHandler();
+        }
+        if (created && !change_filename_.empty()) {
+            created = model_->ApplyChange(change_filename_);
+        }
+        if (created && !compare_filename_.empty()) {
+            created = CompareWithRebuild();
+        }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - request_start_);
+        LOG_INFO("", "Time to model: {} ms.", elapsed.count());
+        return created;
+    }
+
+    bool RouteApplication::CompareWithRebuild() {
+        LOG_INFO("", "Comparing the model with a full rebuild from '{}'...", compare_filename_);
+        QueryFile query_file{ NULL, compare_filename_ };
+        AppData compare_data = *data_;
+        compare_data.sm = StorageMethod::FILE_STORAGE;
+        compare_data.query_file = &query_file;
+        Model rebuilt_model(&compare_data);
+        if (rebuilt_model.WasModelCreated() && model_->MatchesRoadGraph(rebuilt_model)) {
+            LOG_INFO("", "The model matches the full rebuild.");
+            return true;
+        }
+        LOG_ERROR("", "Error: The model does not match the full rebuild.");
+        return false;
     }
 
-    void RouteApplication::FindRoute() {
-        PrintDebugMessage(APPLICATION_NAME, "", "Finding route...", true);
+    // With -stops, the route is the planned tour of the stops instead of the route from -start to -end.
+    // Returns false when the tour could not be planned.
+    bool RouteApplication::FindRoute() {
+        if (IsPlanningTour()) {
+            return PlanTour();
+        }
+        METRICS_SCOPE("app.find_route");
+        LOG_INFO("", "Finding route...");
         pathfinder_ = new Pathfinder(model_, data_);
         pathfinder_->CreateRoute();
         ReleasePathfinder();
+        return true;
+    }
+
+    // Builds a model from map data files for a server reload; the files are those given with -f.
+    Model* RouteApplication::LoadModel(const string& filenames) {
+        AppData reload_data = *data_;
+        QueryFile query_file{ NULL, filenames };
+        if (reload_data.sm != StorageMethod::TILE_STORAGE) {
+            reload_data.sm = StorageMethod::FILE_STORAGE;
+            reload_data.query_file = &query_file;
+        }
+        Model* model = new Model(&reload_data);
+        if (!model->WasModelCreated()) {
+            delete model;
+            return NULL;
+        }
+        return model;
     }
 
-    void RouteApplication::Render() {
-        PrintDebugMessage(APPLICATION_NAME, "", "Initializing renderer...", true);
+    bool RouteApplication::IsServing() const {
+        return server_port_ > 0;
+    }
+
+    // Runs the headless route server on the loaded model until SIGINT (Ctrl+C) is received.
+    bool RouteApplication::Serve() {
+        LOG_INFO("", "Starting route server...");
+        signal(SIGINT, [](int) { RouteServer::RequestStop(); });
+#ifdef SIGHUP
+        signal(SIGHUP, [](int) { RouteServer::RequestReload(); });
+#endif
+        RouteServer::ModelLoader loader;
+        if (!reload_filename_.empty()) {
+            loader = [this]() { return LoadModel(reload_filename_); };
+        }
+        RouteServer server(model_, server_port_, (size_t)std::max(1, server_threads_), loader);
+        model_ = NULL;
+        unique_ptr<QueryLog> query_log;
+        if (!query_log_filename_.empty()) {
+            query_log = make_unique<QueryLog>(query_log_filename_);
+            if (!query_log->IsOpen()) {
+                return false;
+            }
+            server.SetQueryLog(query_log.get());
+        }
+        return server.Run();
+    }
+
+    // Opens the window; returns false, without opening it, when the view options are invalid.
+    bool RouteApplication::Render() {
+        LOG_INFO("", "Initializing renderer...");
         renderer_ = new Renderer(model_);
+        renderer_->SetRasterCache(raster_cache_);
+        if (!InitializeView()) {
+            return false;
+        }
         DisplayMap();
+        return true;
+    }
+
+    // Applies -zoom and -center (lon,lat); without -center the view is centered on the map. Returns false
+    // when -center is malformed.
+    bool RouteApplication::InitializeView() {
+        if (view_zoom_ == 1.f && view_center_.empty()) {
+            return true;
+        }
+        double min_lon, min_lat, max_lon, max_lat;
+        model_->GetBounds(min_lon, min_lat, max_lon, max_lat);
+        double lon = (min_lon + max_lon) / 2.;
+        double lat = (min_lat + max_lat) / 2.;
+        if (!view_center_.empty() && sscanf(view_center_.c_str(), "%lf,%lf", &lon, &lat) != 2) {
+            LOG_ERROR("", "Error: The center '{}' is not in the form lon,lat.", view_center_);
+            return false;
+        }
+        renderer_->SetView(model_->ProjectCoordinates(lon, lat), view_zoom_);
+        return true;
+    }
+
+    bool RouteApplication::IsHeadless() const {
+        return !png_filename_.empty() || !batch_filename_.empty();
+    }
+
+    // Reads -size as WIDTHxHEIGHT; the default is the size of the window.
+    bool RouteApplication::GetImageSize(int& width, int& height) const {
+        width = (int)(600 * model_->GetAspectRatio());
+        height = 600;
+        if (!image_size_.empty() && (sscanf(image_size_.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+            LOG_ERROR("", "Error: The image size '{}' is not in the form WIDTHxHEIGHT.", image_size_);
+            return false;
+        }
+        return true;
+    }
+
+    // Renders the route found from -start to -end into the -png file instead of opening a window.
+    bool RouteApplication::RenderToFile() {
+        if (!batch_filename_.empty()) {
+            return RenderBatch();
+        }
+        LOG_INFO("", "Rendering to '{}'...", png_filename_);
+        int width, height;
+        if (!GetImageSize(width, height)) {
+            return false;
+        }
+        if (!FindRoute()) {
+            return false;
+        }
+        renderer_ = new Renderer(model_);
+        renderer_->SetRasterCache(raster_cache_);
+        if (!InitializeView()) {
+            return false;
+        }
+        return renderer_->RenderToFile(png_filename_, width, height);
+    }
+
+    // Renders one image per line of the -batch file, "from_lon,from_lat to_lon,to_lat image.png". The
+    // model, the road graph and the rasterized static layers are shared by all routes.
+    bool RouteApplication::RenderBatch() {
+        LOG_INFO("", "Rendering the routes of '{}'...", batch_filename_);
+        int width, height;
+        if (!GetImageSize(width, height)) {
+            return false;
+        }
+        ifstream batch(batch_filename_);
+        if (!batch) {
+            LOG_ERROR("", "Error opening file '{}'.", batch_filename_);
+            return false;
+        }
+        RoadGraph graph(*model_);
+        renderer_ = new Renderer(model_);
+        renderer_->SetRasterCache(true);
+        if (!InitializeView()) {
+            return false;
+        }
+
+        auto start_time = chrono::steady_clock::now();
+        int rendered = 0;
+        int failed = 0;
+        int line_number = 0;
+        string line;
+        while (getline(batch, line)) {
+            line_number++;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            istringstream fields(line);
+            string from, to, filename;
+            double from_lon, from_lat, to_lon, to_lat;
+            if (!(fields >> from >> to >> filename) || sscanf(from.c_str(), "%lf,%lf", &from_lon, &from_lat) != 2 ||
+                sscanf(to.c_str(), "%lf,%lf", &to_lon, &to_lat) != 2) {
+                LOG_ERROR("", "Error: Line {} is not in the form 'lon,lat lon,lat image.png'.", line_number);
+                failed++;
+                continue;
+            }
+            model_->GetStartingPoint() = model_->ProjectCoordinates(from_lon, from_lat);
+            model_->GetEndingPoint() = model_->ProjectCoordinates(to_lon, to_lat);
+            RoadGraph::Route route;
+            if (!graph.FindRoute(graph.NearestNode(model_->GetStartingPoint()), graph.NearestNode(model_->GetEndingPoint()), route)) {
+                LOG_WARNING("", "No route found on line {}, only the points are drawn.", line_number);
+            }
+            model_->GetRoute().nodes = std::move(route.nodes);
+            renderer_->UpdateRoute();
+            if (renderer_->RenderToFile(filename, width, height)) {
+                rendered++;
+            }
+            else {
+                failed++;
+            }
+        }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+        LOG_INFO("", "{} images rendered in {} ms ({} ms per image), {} failed.", rendered, elapsed.count(), rendered > 0 ? elapsed.count() / (double)rendered : 0., failed);
+        return failed == 0;
+    }
+
+    bool RouteApplication::IsRenderingTiles() const {
+        return !tile_directory_.empty();
+    }
+
+    // Renders the map tiles of the -tile_zoom levels (MIN-MAX) into -render_tiles on -threads threads.
+    bool RouteApplication::RenderTiles() {
+        int min_zoom, max_zoom;
+        if (sscanf(tile_zoom_.c_str(), "%d-%d", &min_zoom, &max_zoom) != 2 || min_zoom < 0 || min_zoom > max_zoom) {
+            LOG_ERROR("", "Error: The zoom levels '{}' are not in the form MIN-MAX.", tile_zoom_);
+            return false;
+        }
+        TileRenderer tile_renderer(model_, tile_directory_, min_zoom, max_zoom, (size_t)std::max(1, server_threads_));
+        return tile_renderer.Run();
+    }
+
+    bool RouteApplication::IsComputingMatrix() const {
+        return !matrix_filename_.empty();
+    }
+
+    // Reads one 'lon,lat' per line and snaps the points to the nearest road nodes.
+    bool RouteApplication::ReadPoints(const string& filename, const RoadGraph& graph, vector<int>& node_numbers) {
+        ifstream points(filename);
+        if (!points) {
+            LOG_ERROR("", "Error opening file '{}'.", filename);
+            return false;
+        }
+        int line_number = 0;
+        string line;
+        while (getline(points, line)) {
+            line_number++;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            double lon, lat;
+            if (sscanf(line.c_str(), "%lf,%lf", &lon, &lat) != 2) {
+                LOG_ERROR("", "Error: Line {} of '{}' is not in the form 'lon,lat'.", line_number, filename);
+                return false;
+            }
+            node_numbers.emplace_back(graph.NearestNode(model_->ProjectCoordinates(lon, lat)));
+        }
+        return true;
+    }
+
+    // Writes the road distances from every point of -sources to every point of -targets (by default the
+    // sources themselves) to -matrix, computed on -threads threads.
+    bool RouteApplication::ComputeMatrix() {
+        LOG_INFO("", "Computing the distance matrix of '{}' and '{}'...", sources_filename_, targets_filename_);
+        RoadGraph graph(*model_);
+        vector<int> sources, targets;
+        if (!ReadPoints(sources_filename_, graph, sources) || !ReadPoints(targets_filename_, graph, targets)) {
+            return false;
+        }
+        DistanceMatrix matrix(graph, sources, targets);
+        matrix.Compute((size_t)std::max(1, server_threads_));
+        return matrix.Write(matrix_filename_);
+    }
+
+    bool RouteApplication::IsPlanningTour() const {
+        return !stops_filename_.empty();
+    }
+
+    // Plans a round trip from the first point of -stops through all the others, with -tour_budget
+    // milliseconds of local search on -threads threads, and makes it the route that is drawn. The order
+    // of the stops is written to -tour.
+    bool RouteApplication::PlanTour() {
+        LOG_INFO("", "Planning a tour of the stops in '{}'...", stops_filename_);
+        RoadGraph graph(*model_);
+        vector<int> stops;
+        if (!ReadPoints(stops_filename_, graph, stops)) {
+            return false;
+        }
+        TourPlanner planner(graph, stops);
+        RoadGraph::Route route;
+        if (!planner.Plan((size_t)std::max(1, server_threads_), chrono::milliseconds(std::max(0, tour_budget_))) || !planner.BuildRoute(route)) {
+            return false;
+        }
+        model_->GetStartingPoint() = model_->GetNodes()[stops.front()];
+        model_->GetEndingPoint() = model_->GetNodes()[stops.front()];
+        model_->GetRoute().nodes = std::move(route.nodes);
+        return tour_filename_.empty() || planner.Write(tour_filename_);
+    }
+
+    bool RouteApplication::IsBenchmarkingFrames() const {
+        return benchmark_frames_ > 0;
+    }
+
+    // Draws -frame_benchmark frames of the map and the route offscreen with one path per feature and with
+    // style-batched paths, and prints the frame times and draw calls of both, instead of opening a window.
+    bool RouteApplication::CompareFrameTimes() {
+        LOG_INFO("", "Comparing frame times...");
+        int width, height;
+        if (!GetImageSize(width, height) || !FindRoute()) {
+            return false;
+        }
+        renderer_ = new Renderer(model_);
+        if (!InitializeView()) {
+            return false;
+        }
+        for (bool batching : { false, true }) {
+            renderer_->SetBatching(batching);
+            double frame_time = renderer_->MeasureFrameTime(width, height, benchmark_frames_);
+            LOG_INFO("", "{}: {} draw calls, {} ms per frame.", batching ? "Batched" : "Unbatched", renderer_->GetDrawCallCount(), frame_time);
+        }
+        return true;
+    }
+
+    // Writes the -metrics report and the -trace timeline of the run.
+    void RouteApplication::WriteMetrics() {
+        if (!Metrics::IsEnabled()) {
+            return;
+        }
+        if (!metrics_filename_.empty()) {
+            Metrics::WriteReport(metrics_filename_);
+        }
+        if (!trace_filename_.empty()) {
+            Metrics::WriteTrace(trace_filename_);
+        }
     }
 
     void RouteApplication::DisplayMap() {
-        auto display = io2d::output_surface{ (int)(600 * model_->GetAspectRatio()), 600, io2d::format::argb32, io2d::scaling::none, io2d::refresh_style::fixed, 30 };
+        auto display = io2d::output_surface{ (int)(600 * model_->GetAspectRatio()), 600, io2d::format::argb32, io2d::scaling::none, io2d::refresh_style::as_needed, 30 };
         renderer_->Initialize(display);
 
+        // The map only changes when the window is resized, so frames are drawn on demand instead of at a fixed rate.
         display.size_change_callback([&](io2d::output_surface& surface) {
             renderer_->Resize(surface);
+            surface.redraw_required();
             });
 
         display.draw_callback([&](io2d::output_surface& surface) {
             renderer_->Display(surface);
             });
+        display.redraw_required();
         display.begin_show();
     }
 
     RouteApplication::~RouteApplication() {
-        PrintDebugMessage(APPLICATION_NAME, "", "Releasing application resources...", true);
+        LOG_DEBUG("", "Releasing application resources...");
         Release();
+        curl_global_cleanup();
     }
 
     void RouteApplication::Release() {
+        if (cache_ != NULL) {
+            cache_->PrintStatistics();
+            delete cache_;
+            cache_ = NULL;
+        }
         if (renderer_ != NULL) {
             delete renderer_;
             renderer_ = NULL;
@@ -238,6 +863,10 @@ namespace route_app {
                 delete data_->query_data;
                 data_->query_data = NULL;
             }
+            else if (data_->sm == StorageMethod::STREAM_STORAGE) {
+                delete data_->osm_stream;
+                data_->osm_stream = NULL;
+            }
             delete data_;
             data_ = NULL;
         }
@@ -275,15 +904,36 @@ namespace route_app {
 }
 
 int main(int argc, char** argv) {
+    int exit_code = EXIT_FAILURE;
     route_app::RouteApplication *routeApp = new route_app::RouteApplication(argc, argv);
     if (routeApp->ParseCommandLineArguments(argc, argv)) {
         routeApp->Initialize();
         if (routeApp->HTTPRequest()) {
             if (routeApp->ModelData()) {
-                routeApp->FindRoute();
-                routeApp->Render();
+                bool succeeded = true;
+                if (routeApp->IsServing()) {
+                    succeeded = routeApp->Serve();
+                }
+                else if (routeApp->IsRenderingTiles()) {
+                    succeeded = routeApp->RenderTiles();
+                }
+                else if (routeApp->IsComputingMatrix()) {
+                    succeeded = routeApp->ComputeMatrix();
+                }
+                else if (routeApp->IsBenchmarkingFrames()) {
+                    succeeded = routeApp->CompareFrameTimes();
+                }
+                else if (routeApp->IsHeadless()) {
+                    succeeded = routeApp->RenderToFile();
+                }
+                else {
+                    succeeded = routeApp->FindRoute() && routeApp->Render();
+                }
+                exit_code = succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
             }
         }
+        routeApp->WriteMetrics();
     }
     delete routeApp;
+    return exit_code;
 }
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include <zlib.h>
+#include <bzlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Writes synthetic OSM maps of a given size for scaling tests: a street grid, a radial city of ring roads
+// and spokes, or a random planar network (a jittered grid with missing streets and diagonals). Blocks hold
+// square buildings, and some of them grass or water multipolygons with a hole, whose outer ring is split
+// over two ways so that the ring stitching is exercised as well. Every node position and random choice
+// is derived from a hash of its lattice coordinates and the seed, so maps of any size are streamed to the
+// file without being held in memory, and the same options always give the same map. Filenames ending in
+// .gz or .bz2 are written compressed.
+//
+// usage: MapGenerator -nodes 100000 [-type grid|radial|random] [-seed 1] [-spacing 100] [-output map.osm]
+
+struct Options {
+    long long nodes = 100000;
+    string type = "grid";
+    unsigned int seed = 1;
+    double spacing = 100.;
+    string output = "map.osm";
+};
+
+static const double PI = 3.14159265358979323846264338327950288;
+static const double CENTER_LON = 18.06;
+static const double CENTER_LAT = 59.33;
+static const double METERS_PER_DEGREE = 111320.;
+static const int MAX_WAY_NODES = 1000;
+// Nodes reserved per block for a building (4) or a multipolygon (4 outer and 4 inner).
+static const int BLOCK_NODES = 8;
+
+// Buffers the document and writes it plain, gzip or bzip2 compressed depending on the filename.
+class OutputFile {
+private:
+    FILE* file_ = NULL;
+    gzFile gz_file_ = NULL;
+    BZFILE* bz_file_ = NULL;
+    string buffer_;
+    bool failed_ = false;
+
+    static bool EndsWith(const string& text, const string& suffix) {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+public:
+    bool Open(const string& filename) {
+        if (EndsWith(filename, ".gz")) {
+            gz_file_ = gzopen(filename.c_str(), "wb6");
+            return gz_file_ != NULL;
+        }
+        file_ = fopen(filename.c_str(), "wb");
+        if (file_ != NULL && EndsWith(filename, ".bz2")) {
+            int error;
+            bz_file_ = BZ2_bzWriteOpen(&error, file_, 9, 0, 0);
+            if (error != BZ_OK) {
+                fclose(file_);
+                file_ = NULL;
+                bz_file_ = NULL;
+                return false;
+            }
+            return true;
+        }
+        return file_ != NULL;
+    }
+
+    void Write(const string& text) {
+        buffer_ += text;
+        if (buffer_.size() >= (1 << 20)) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        if (buffer_.empty()) {
+            return;
+        }
+        if (gz_file_ != NULL) {
+            failed_ |= gzwrite(gz_file_, buffer_.data(), (unsigned int)buffer_.size()) != (int)buffer_.size();
+        }
+        else if (bz_file_ != NULL) {
+            int error;
+            BZ2_bzWrite(&error, bz_file_, buffer_.data(), (int)buffer_.size());
+            failed_ |= error != BZ_OK;
+        }
+        else {
+            failed_ |= fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size();
+        }
+        buffer_.clear();
+    }
+
+    bool Close() {
+        Flush();
+        if (gz_file_ != NULL) {
+            failed_ |= gzclose(gz_file_) != Z_OK;
+        }
+        if (bz_file_ != NULL) {
+            int error;
+            BZ2_bzWriteClose(&error, bz_file_, 0, NULL, NULL);
+            failed_ |= error != BZ_OK;
+        }
+        if (file_ != NULL) {
+            failed_ |= fclose(file_) != 0;
+        }
+        return !failed_;
+    }
+};
+
+// The nodes of the road network form a lattice of columns x rows; the layout maps lattice coordinates
+// to positions and decides which streets exist.
+class Layout {
+private:
+    const Options& options_;
+    bool radial_;
+    bool random_;
+public:
+    long long columns;
+    long long rows;
+
+    explicit Layout(const Options& options) : options_(options) {
+        radial_ = options.type == "radial";
+        random_ = options.type == "random";
+        // A block adds about 2.3 nodes to its lattice node, see BlockKind.
+        long long side = max(4LL, (long long)sqrt(options.nodes / 3.3));
+        columns = side;
+        rows = side;
+    }
+
+    // A uniform value in [0, 1) for the coordinates and the purpose (salt).
+    double Random(long long i, long long j, unsigned int salt) const {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (unsigned long long value : { (unsigned long long)i, (unsigned long long)j, (unsigned long long)salt, (unsigned long long)options_.seed }) {
+            hash = (hash ^ value) * 1099511628211ULL;
+            hash ^= hash >> 29;
+        }
+        return (hash >> 11) * (1. / 9007199254740992.);
+    }
+
+    long long NodeId(long long i, long long j) const {
+        return 1 + j * columns + (i % columns);
+    }
+
+    // Position in meters from the center of the map; i and j may be fractional inside a block.
+    void Position(double i, double j, double& x, double& y) const {
+        if (radial_) {
+            double angle = 2. * PI * i / columns;
+            // The innermost ring starts where its nodes are one spacing apart.
+            double radius = (j + columns / (2. * PI)) * options_.spacing;
+            x = radius * cos(angle);
+            y = radius * sin(angle);
+            return;
+        }
+        x = (i - columns / 2.) * options_.spacing;
+        y = (j - rows / 2.) * options_.spacing;
+    }
+
+    void LatticePosition(long long i, long long j, double& x, double& y) const {
+        Position((double)i, (double)j, x, y);
+        if (random_) {
+            x += (Random(i, j, 1) - 0.5) * 0.4 * options_.spacing;
+            y += (Random(i, j, 2) - 0.5) * 0.4 * options_.spacing;
+        }
+    }
+
+    // Whether the street from (i, j) to the next node along a row (horizontal) or a column exists.
+    bool HasSegment(long long i, long long j, bool horizontal) const {
+        if (horizontal && !radial_ && i + 1 >= columns) {
+            return false;
+        }
+        if (!horizontal && j + 1 >= rows) {
+            return false;
+        }
+        return !random_ || Random(i, j, horizontal ? 3 : 4) >= 0.1;
+    }
+
+    bool HasDiagonal(long long i, long long j) const {
+        return random_ && Random(i, j, 5) < 0.3;
+    }
+
+    long long BlockColumns() const {
+        return radial_ ? columns : columns - 1;
+    }
+
+    // 0: empty, 1: building, 2: grass multipolygon, 3: water multipolygon.
+    int BlockKind(long long i, long long j) const {
+        double value = Random(i, j, 6);
+        if (value < 0.02) return 2;
+        if (value < 0.04) return 3;
+        if (value < 0.54) return 1;
+        return 0;
+    }
+
+    string Highway(long long line) const {
+        if (line % 10 == 0) return "primary";
+        if (line % 5 == 0) return "secondary";
+        if (line % 7 == 3) return "footway";
+        return "residential";
+    }
+};
+
+static void ToLonLat(double x, double y, double& lon, double& lat) {
+    lat = CENTER_LAT + y / METERS_PER_DEGREE;
+    lon = CENTER_LON + x / (METERS_PER_DEGREE * cos(CENTER_LAT * PI / 180.));
+}
+
+static string Coordinates(double x, double y) {
+    char text[64];
+    double lon, lat;
+    ToLonLat(x, y, lon, lat);
+    snprintf(text, sizeof(text), " lat=\"%.7f\" lon=\"%.7f\"", lat, lon);
+    return text;
+}
+
+static string Tag(const string& key, const string& value) {
+    return "    <tag k=\"" + key + "\" v=\"" + value + "\"/>\n";
+}
+
+static string NodeRef(long long id) {
+    return "    <nd ref=\"" + to_string(id) + "\"/>\n";
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string name = argv[i];
+        string value = argv[i + 1];
+        try {
+            if (name == "-nodes") options.nodes = max(100LL, stoll(value));
+            else if (name == "-type") options.type = value;
+            else if (name == "-seed") options.seed = (unsigned int)stoul(value);
+            else if (name == "-spacing") options.spacing = max(10., stod(value));
+            else if (name == "-output") options.output = value;
+            else return false;
+        }
+        catch (const std::exception&) {
+            cout << "'" << value << "' is not a valid value for '" << name << "'." << endl;
+            return false;
+        }
+    }
+    return argc % 2 == 1 && (options.type == "grid" || options.type == "radial" || options.type == "random");
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        cout << "usage: MapGenerator -nodes 100000 [-type grid|radial|random] [-seed 1] [-spacing 100] [-output map.osm]" << endl;
+        return EXIT_FAILURE;
+    }
+    OutputFile output;
+    if (!output.Open(options.output)) {
+        cout << "Error opening file '" << options.output << "'." << endl;
+        return EXIT_FAILURE;
+    }
+    auto start_time = chrono::steady_clock::now();
+    Layout layout(options);
+    long long block_node_base = layout.columns * layout.rows + 1;
+    long long node_count = 0, way_count = 0, relation_count = 0;
+
+    // The corners of a block, shrunk towards its center by inset, so that they stay inside the jitter of
+    // the surrounding streets.
+    auto block_ring = [&](long long i, long long j, double inset, long long first_id) {
+        const double corners[4][2] = { { inset, inset }, { 1. - inset, inset }, { 1. - inset, 1. - inset }, { inset, 1. - inset } };
+        for (int k = 0; k < 4; k++) {
+            double x, y;
+            layout.Position(i + corners[k][0], j + corners[k][1], x, y);
+            output.Write("  <node id=\"" + to_string(first_id + k) + "\"" + Coordinates(x, y) + "/>\n");
+            node_count++;
+        }
+    };
+
+    double min_x = 0., min_y = 0., max_x = 0., max_y = 0.;
+    for (long long j : { 0LL, layout.rows - 1 }) {
+        for (long long i : { 0LL, layout.columns / 4, layout.columns / 2, 3 * layout.columns / 4, layout.columns - 1 }) {
+            double x, y;
+            layout.Position((double)i, (double)j, x, y);
+            min_x = min(min_x, x); max_x = max(max_x, x);
+            min_y = min(min_y, y); max_y = max(max_y, y);
+        }
+    }
+    double min_lon, min_lat, max_lon, max_lat;
+    ToLonLat(min_x - options.spacing, min_y - options.spacing, min_lon, min_lat);
+    ToLonLat(max_x + options.spacing, max_y + options.spacing, max_lon, max_lat);
+    char bounds[160];
+    snprintf(bounds, sizeof(bounds), "  <bounds minlat=\"%.7f\" minlon=\"%.7f\" maxlat=\"%.7f\" maxlon=\"%.7f\"/>\n", min_lat, min_lon, max_lat, max_lon);
+    output.Write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm version=\"0.6\" generator=\"MapGenerator\">\n");
+    output.Write(bounds);
+
+    // Nodes: the lattice, then the corners of the buildings and multipolygons.
+    for (long long j = 0; j < layout.rows; j++) {
+        for (long long i = 0; i < layout.columns; i++) {
+            double x, y;
+            layout.LatticePosition(i, j, x, y);
+            output.Write("  <node id=\"" + to_string(layout.NodeId(i, j)) + "\"" + Coordinates(x, y) + "/>\n");
+            node_count++;
+        }
+    }
+    for (long long j = 0; j + 1 < layout.rows; j++) {
+        for (long long i = 0; i < layout.BlockColumns(); i++) {
+            long long first_id = block_node_base + (j * layout.BlockColumns() + i) * BLOCK_NODES;
+            int kind = layout.BlockKind(i, j);
+            if (kind == 1) {
+                block_ring(i, j, 0.35, first_id);
+            }
+            else if (kind > 1) {
+                block_ring(i, j, 0.25, first_id);
+                block_ring(i, j, 0.4, first_id + 4);
+            }
+        }
+    }
+
+    // Streets: rows and columns become ways that end at missing segments or after MAX_WAY_NODES nodes.
+    auto write_line = [&](long long line, long long length, bool horizontal) {
+        long long start = 0;
+        while (start < length) {
+            long long end = start;
+            while (end < length && end - start < MAX_WAY_NODES &&
+                layout.HasSegment(horizontal ? end : line, horizontal ? line : end, horizontal)) {
+                end++;
+            }
+            if (end > start) {
+                output.Write("  <way id=\"" + to_string(++way_count) + "\">\n");
+                for (long long k = start; k <= end; k++) {
+                    output.Write(NodeRef(horizontal ? layout.NodeId(k, line) : layout.NodeId(line, k)));
+                }
+                output.Write(Tag("highway", layout.Highway(line)) + Tag("name", (horizontal ? "Row " : "Column ") + to_string(line)) + "  </way>\n");
+            }
+            // Continue after a missing segment, or from the last node when the way was long enough.
+            start = end == start ? end + 1 : end;
+        }
+    };
+    bool radial = options.type == "radial";
+    for (long long j = 0; j < layout.rows; j++) {
+        write_line(j, radial ? layout.columns : layout.columns - 1, true);
+    }
+    for (long long i = 0; i < layout.columns; i++) {
+        write_line(i, layout.rows - 1, false);
+    }
+    for (long long j = 0; j + 1 < layout.rows; j++) {
+        for (long long i = 0; i + 1 < layout.columns; i++) {
+            if (layout.HasDiagonal(i, j)) {
+                output.Write("  <way id=\"" + to_string(++way_count) + "\">\n" + NodeRef(layout.NodeId(i, j)) + NodeRef(layout.NodeId(i + 1, j + 1)) +
+                    Tag("highway", "residential") + "  </way>\n");
+            }
+        }
+    }
+
+    // Buildings are closed ways; multipolygons have an outer ring of two open ways and a closed inner ring.
+    long long first_block_way = way_count + 1;
+    for (long long j = 0; j + 1 < layout.rows; j++) {
+        for (long long i = 0; i < layout.BlockColumns(); i++) {
+            long long first_id = block_node_base + (j * layout.BlockColumns() + i) * BLOCK_NODES;
+            int kind = layout.BlockKind(i, j);
+            if (kind == 1) {
+                output.Write("  <way id=\"" + to_string(++way_count) + "\">\n" + NodeRef(first_id) + NodeRef(first_id + 1) + NodeRef(first_id + 2) +
+                    NodeRef(first_id + 3) + NodeRef(first_id) + Tag("building", "yes") + "  </way>\n");
+            }
+            else if (kind > 1) {
+                output.Write("  <way id=\"" + to_string(++way_count) + "\">\n" + NodeRef(first_id) + NodeRef(first_id + 1) + NodeRef(first_id + 2) + "  </way>\n");
+                output.Write("  <way id=\"" + to_string(++way_count) + "\">\n" + NodeRef(first_id + 2) + NodeRef(first_id + 3) + NodeRef(first_id) + "  </way>\n");
+                output.Write("  <way id=\"" + to_string(++way_count) + "\">\n" + NodeRef(first_id + 4) + NodeRef(first_id + 5) + NodeRef(first_id + 6) +
+                    NodeRef(first_id + 7) + NodeRef(first_id + 4) + "  </way>\n");
+            }
+        }
+    }
+
+    // The relations refer to the block ways in the order they were written.
+    long long way_id = first_block_way;
+    for (long long j = 0; j + 1 < layout.rows; j++) {
+        for (long long i = 0; i < layout.BlockColumns(); i++) {
+            int kind = layout.BlockKind(i, j);
+            if (kind == 1) {
+                way_id++;
+            }
+            else if (kind > 1) {
+                output.Write("  <relation id=\"" + to_string(++relation_count) + "\">\n");
+                output.Write("    <member type=\"way\" ref=\"" + to_string(way_id) + "\" role=\"outer\"/>\n");
+                output.Write("    <member type=\"way\" ref=\"" + to_string(way_id + 1) + "\" role=\"outer\"/>\n");
+                output.Write("    <member type=\"way\" ref=\"" + to_string(way_id + 2) + "\" role=\"inner\"/>\n");
+                output.Write(Tag("type", "multipolygon") + (kind == 2 ? Tag("landuse", "grass") : Tag("natural", "water")) + "  </relation>\n");
+                way_id += 3;
+            }
+        }
+    }
+    output.Write("</osm>\n");
+    if (!output.Close()) {
+        cout << "Error writing file '" << options.output << "'." << endl;
+        return EXIT_FAILURE;
+    }
+
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+    cout << "Wrote " << node_count << " nodes, " << way_count << " ways and " << relation_count << " relations (" << options.type << ", "
+        << layout.columns << "x" << layout.rows << " lattice) to '" << options.output << "' in " << elapsed.count() << " ms." << endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include "Helper.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+using namespace route_app;
+
+mutex Metrics::mutex_;
+map<string, unique_ptr<Metrics::Counter>> Metrics::counters_;
+map<string, unique_ptr<Metrics::Timer>> Metrics::timers_;
+map<string, double> Metrics::gauges_;
+vector<Metrics::TraceEvent> Metrics::trace_events_;
+long long Metrics::dropped_trace_events_ = 0;
+atomic<bool> Metrics::trace_enabled_{ false };
+const chrono::steady_clock::time_point Metrics::start_time_ = chrono::steady_clock::now();
+
+// Small sequential thread ids, which trace viewers show as one row each.
+static int CurrentThread() {
+	static atomic<int> next_thread{ 0 };
+	thread_local int thread = next_thread++;
+	return thread;
+}
+
+void Metrics::Timer::Record(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+	long long ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+	count_.fetch_add(1, memory_order_relaxed);
+	total_ns_.fetch_add(ns, memory_order_relaxed);
+	long long max_ns = max_ns_.load(memory_order_relaxed);
+	while (ns > max_ns && !max_ns_.compare_exchange_weak(max_ns, ns, memory_order_relaxed)) {
+	}
+	if (trace_enabled_.load(memory_order_relaxed)) {
+		AddTraceEvent(*this, start, end);
+	}
+}
+
+bool Metrics::IsEnabled() {
+#ifdef ROUTE_APP_METRICS
+	return true;
+#else
+	return false;
+#endif
+}
+
+Metrics::Counter& Metrics::GetCounter(const string& name) {
+	lock_guard<mutex> lock(mutex_);
+	auto& counter = counters_[name];
+	if (!counter) {
+		counter = make_unique<Counter>();
+	}
+	return *counter;
+}
+
+Metrics::Timer& Metrics::GetTimer(const string& name) {
+	lock_guard<mutex> lock(mutex_);
+	auto& timer = timers_[name];
+	if (!timer) {
+		timer = make_unique<Timer>(name);
+	}
+	return *timer;
+}
+
+void Metrics::SetGauge(const string& name, double value) {
+	lock_guard<mutex> lock(mutex_);
+	gauges_[name] = value;
+}
+
+void Metrics::EnableTrace(bool enabled) {
+	trace_enabled_ = enabled;
+}
+
+void Metrics::AddTraceEvent(const Timer& timer, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+	TraceEvent event{ &timer, CurrentThread(), chrono::duration_cast<chrono::microseconds>(start - start_time_).count(),
+		chrono::duration_cast<chrono::microseconds>(end - start).count() };
+	lock_guard<mutex> lock(mutex_);
+	if (trace_events_.size() >= MAX_TRACE_EVENTS) {
+		dropped_trace_events_++;
+		return;
+	}
+	trace_events_.push_back(event);
+}
+
+// Writes the counters, gauges and timers (count, total and maximum in milliseconds) as one JSON object.
+bool Metrics::WriteReport(const string& filename) {
+	ofstream report(filename);
+	if (!report) {
+		LOG_ERROR("Metrics", "Error opening file '{}'.", filename);
+		return false;
+	}
+	lock_guard<mutex> lock(mutex_);
+	report << fixed << setprecision(3) << "{\n\"counters\":{";
+	const char* separator = "";
+	for (auto& [name, counter] : counters_) {
+		report << separator << "\n\"" << name << "\":" << counter->Get();
+		separator = ",";
+	}
+	report << "},\n\"gauges\":{";
+	separator = "";
+	for (auto& [name, value] : gauges_) {
+		report << separator << "\n\"" << name << "\":" << value;
+		separator = ",";
+	}
+	report << "},\n\"timers\":{";
+	separator = "";
+	for (auto& [name, timer] : timers_) {
+		report << separator << "\n\"" << name << "\":{\"count\":" << timer->GetCount() << ",\"total_ms\":" << timer->GetTotalMilliseconds()
+			<< ",\"max_ms\":" << timer->GetMaxMilliseconds() << "}";
+		separator = ",";
+	}
+	report << "}\n}" << endl;
+	LOG_INFO("Metrics", "Metrics written to '{}'.", filename);
+	return true;
+}
+
+// Writes the recorded timer scopes as complete ("X") events of the Chrome trace-event format, which
+// chrome://tracing and Perfetto show as a timeline per thread.
+bool Metrics::WriteTrace(const string& filename) {
+	ofstream trace(filename);
+	if (!trace) {
+		LOG_ERROR("Metrics", "Error opening file '{}'.", filename);
+		return false;
+	}
+	lock_guard<mutex> lock(mutex_);
+	trace << "{\"traceEvents\":[";
+	for (size_t i = 0; i < trace_events_.size(); i++) {
+		auto& event = trace_events_[i];
+		trace << (i > 0 ? "," : "") << "\n{\"name\":\"" << event.timer->GetName() << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+			<< ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us << "}";
+	}
+	trace << "\n],\"displayTimeUnit\":\"ms\"}" << endl;
+	LOG_INFO("Metrics", "{} trace events written to '{}'.", trace_events_.size(), filename);
+	if (dropped_trace_events_ > 0) {
+		LOG_WARNING("Metrics", "Warning: The trace is full; {} later events were dropped.", dropped_trace_events_);
+	}
+	return true;
+}
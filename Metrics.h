@@ -0,0 +1,120 @@
+#pragma once
+#ifndef ROUTE_APP_METRICS_H
+#define ROUTE_APP_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Scoped timers, counters and gauges for the pipeline stages and the search loops. They are only compiled
+// in when ROUTE_APP_METRICS is defined (the CMake option of the same name); otherwise the macros expand to
+// nothing and cost nothing. Every macro looks its metric up once per call site and then only touches
+// atomics, so they may be used from any thread.
+#ifdef ROUTE_APP_METRICS
+#define METRICS_CONCAT_INNER(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_INNER(a, b)
+#define METRICS_SCOPE(name) \
+	static route_app::Metrics::Timer& METRICS_CONCAT(metrics_timer_, __LINE__) = route_app::Metrics::GetTimer(name); \
+	route_app::Metrics::ScopedTimer METRICS_CONCAT(metrics_scope_, __LINE__)(METRICS_CONCAT(metrics_timer_, __LINE__))
+#define METRICS_COUNT(name, value) \
+	do { static route_app::Metrics::Counter& counter = route_app::Metrics::GetCounter(name); counter.Add((long long)(value)); } while (0)
+#define METRICS_GAUGE(name, value) route_app::Metrics::SetGauge(name, (double)(value))
+#define METRICS_SEARCH(prefix, counters) \
+	do { \
+		METRICS_COUNT(prefix ".nodes_expanded", (counters).expanded); \
+		METRICS_COUNT(prefix ".heap_pushes", (counters).pushes); \
+		METRICS_COUNT(prefix ".heap_pops", (counters).pops); \
+		METRICS_COUNT(prefix ".neighbours_scanned", (counters).neighbours); \
+		METRICS_COUNT(prefix ".searches", 1); \
+	} while (0)
+#else
+#define METRICS_SCOPE(name)
+#define METRICS_COUNT(name, value) do { } while (0)
+#define METRICS_GAUGE(name, value) do { } while (0)
+#define METRICS_SEARCH(prefix, counters) do { } while (0)
+#endif
+
+namespace route_app {
+
+	// The work of one shortest path search. A search counts into its own instance and reports it with
+	// METRICS_SEARCH when it ends, so that the search loop touches no shared state.
+	struct SearchCounters {
+		long long expanded = 0;
+		long long pushes = 0;
+		long long pops = 0;
+		long long neighbours = 0;
+	};
+
+	class Metrics {
+	public:
+		class Counter {
+		private:
+			atomic<long long> value_{ 0 };
+		public:
+			void Add(long long value) { value_.fetch_add(value, memory_order_relaxed); }
+			long long Get() const { return value_.load(memory_order_relaxed); }
+		};
+
+		class Timer {
+		private:
+			string name_;
+			atomic<long long> count_{ 0 };
+			atomic<long long> total_ns_{ 0 };
+			atomic<long long> max_ns_{ 0 };
+		public:
+			explicit Timer(string name) : name_(std::move(name)) {}
+			void Record(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end);
+			const string& GetName() const { return name_; }
+			long long GetCount() const { return count_.load(memory_order_relaxed); }
+			double GetTotalMilliseconds() const { return total_ns_.load(memory_order_relaxed) / 1e6; }
+			double GetMaxMilliseconds() const { return max_ns_.load(memory_order_relaxed) / 1e6; }
+		};
+
+		class ScopedTimer {
+		private:
+			Timer& timer_;
+			chrono::steady_clock::time_point start_;
+		public:
+			explicit ScopedTimer(Timer& timer) : timer_(timer), start_(chrono::steady_clock::now()) {}
+			~ScopedTimer() { timer_.Record(start_, chrono::steady_clock::now()); }
+		};
+
+		static bool IsEnabled();
+		static Counter& GetCounter(const string& name);
+		static Timer& GetTimer(const string& name);
+		static void SetGauge(const string& name, double value);
+		static void EnableTrace(bool enabled);
+		static bool WriteReport(const string& filename);
+		static bool WriteTrace(const string& filename);
+	private:
+		// A completed timer scope, for the Chrome trace-event file.
+		struct TraceEvent {
+			const Timer* timer;
+			int thread;
+			long long start_us;
+			long long duration_us;
+		};
+
+		static mutex mutex_;
+		static map<string, unique_ptr<Counter>> counters_;
+		static map<string, unique_ptr<Timer>> timers_;
+		static map<string, double> gauges_;
+		// The trace keeps the first MAX_TRACE_EVENTS scopes, so that a long run such as -serve cannot grow
+		// it without bound; later scopes are only counted.
+		static const size_t MAX_TRACE_EVENTS = 1 << 20;
+		static vector<TraceEvent> trace_events_;
+		static long long dropped_trace_events_;
+		static atomic<bool> trace_enabled_;
+		static const chrono::steady_clock::time_point start_time_;
+
+		static void AddTraceEvent(const Timer& timer, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end);
+	};
+}
+
+#endif
@@ -1,13 +1,37 @@
 #include <iostream>
 #include <cmath>
 #include <algorithm>
-#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <thread>
 #include "Model.h"
 #include "Helper.h"
+#include "Logger.h"
+#include "OSMStream.h"
+#include "CompressedFile.h"
+#include "Metrics.h"
 
 using namespace pugi;
 using namespace route_app;
 
+// Loads a plain or a gzip/bzip2 compressed OSM file. A compressed file is decompressed into buffer and
+// parsed in place, so that only one copy of the text is held; buffer must outlive the document.
+static xml_parse_result LoadDocument(xml_document& doc, const string& filename, vector<char>& buffer) {
+	if (!CompressedFile::IsCompressed(filename)) {
+		return doc.load_file(filename.c_str());
+	}
+	if (!CompressedFile::ReadAll(filename, buffer)) {
+		xml_parse_result result;
+		result.status = status_io_error;
+		return result;
+	}
+	return doc.load_buffer_inplace(buffer.data(), buffer.size());
+}
+
 static Model::Road::Type StringToRoadType(string_view type) {
 	if (type == "motorway")        return Model::Road::Motorway;
 	if (type == "motorway_link")   return Model::Road::Motorway;
@@ -39,29 +63,307 @@ static Model::Landuse::Type StringToLanduseType(string_view type) {
 	return Model::Landuse::Invalid;
 }
 
+// Returns the layer a way or relation tag belongs to, or 0 when the tag is not rendered or routed.
+static int TagToLayer(string_view category, string_view type) {
+	using L = Model::LayerFlags;
+	if (category == "highway")
+		return StringToRoadType(type) != Model::Road::Invalid ? (int)L::ROADS : 0;
+	if (category == "building")
+		return (int)L::BUILDINGS;
+	if (category == "amenity")
+		return type == "school" ? (int)L::BUILDINGS : 0;
+	if (category == "railway")
+		return (int)L::RAILWAYS;
+	if (category == "leisure" || (category == "natural" && (type == "wood" || type == "tree_row" || type == "scrub" || type == "grassland")) || (category == "landcover" && type == "grass"))
+		return (int)L::LEISURES;
+	if (category == "natural" && (type == "water" || type == "coastline"))
+		return (int)L::WATERS;
+	if (category == "landuse")
+		return StringToLanduseType(type) != Model::Landuse::Invalid ? (int)L::LANDUSES : 0;
+	return 0;
+}
+
+int Model::LayersFromString(string_view layers) {
+	using L = Model::LayerFlags;
+	int flags = 0;
+	while (!layers.empty()) {
+		auto separator = layers.find(',');
+		auto layer = layers.substr(0, separator);
+		if (layer == "roads")           flags |= (int)L::ROADS;
+		else if (layer == "buildings")  flags |= (int)L::BUILDINGS;
+		else if (layer == "landuses")   flags |= (int)L::LANDUSES;
+		else if (layer == "leisures")   flags |= (int)L::LEISURES;
+		else if (layer == "waters")     flags |= (int)L::WATERS;
+		else if (layer == "railways")   flags |= (int)L::RAILWAYS;
+		else if (layer == "all")        flags |= (int)L::ALL;
+		else return -1;
+		layers = separator == string_view::npos ? string_view{} : layers.substr(separator + 1);
+	}
+	return flags;
+}
+
 Model::Model(AppData* data) {
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Initiating model...", false);
-	if (OpenDocument(data)) {
+	LOG_DEBUG("Model", "Initiating model...");
+	layers_ = data->layers;
+	if (data->sm == StorageMethod::STREAM_STORAGE) {
+		model_created_ = ParseStream(data->osm_stream);
+	}
+	else if (data->sm == StorageMethod::TILE_STORAGE) {
+		model_created_ = LoadTiles(data->tiles);
+	}
+	else if (OpenDocument(data)) {
 		ParseData(data);
-		AdjustCoordinates(data);
-		CreateRoadGraph();
 		model_created_ = true;
 	}
 	else {
-		PrintDebugMessage(APPLICATION_NAME, "Model", "Error: Failed to parse the xml file.", false);
 		model_created_ = false;
 	}
+
+	if (model_created_) {
+		AdjustCoordinates(data);
+		CreateRoadGraph();
+	}
+	else {
+		LOG_ERROR("Model", "Error: Failed to parse the xml file.");
+	}
+}
+
+// Builds a model of the selected layers from a map file, as the tools load their maps. Returns NULL if the
+// file cannot be loaded; the caller owns the model.
+Model* Model::Load(const string& filename, unsigned int layers) {
+	QueryFile query_file{ NULL, filename };
+	AppData data{};
+	data.sm = StorageMethod::FILE_STORAGE;
+	data.query_file = &query_file;
+	data.use_aspect_ratio = true;
+	data.layers = layers;
+	Model* model;
+	try {
+		model = new Model(&data);
+	}
+	catch (const std::logic_error& error) {
+		LOG_ERROR("Model", "Error: {}", error.what());
+		return NULL;
+	}
+	if (!model->WasModelCreated()) {
+		delete model;
+		return NULL;
+	}
+	return model;
+}
+
+// Loads a single tile without projecting it or building its road graph; used by LoadTiles.
+Model::Model(const QueryTile& tile, unsigned int layers) {
+	layers_ = layers;
+	xml_parse_result result;
+	if (tile.filename.empty()) {
+		result = doc_.load_buffer(tile.buffer.data(), tile.buffer.size());
+	}
+	else {
+		result = LoadDocument(doc_, tile.filename, doc_buffer_);
+	}
+
+	model_created_ = false;
+	if (result) {
+		try {
+			ParseData(nullptr);
+			model_created_ = true;
+		}
+		catch (const std::logic_error& error) {
+			LOG_ERROR("Model", "Error: {}", error.what());
+		}
+	}
+}
+
+// Parses every tile on its own worker thread and merges the results, in tile order, into this model.
+bool Model::LoadTiles(const vector<QueryTile>& tiles) {
+	METRICS_SCOPE("model.load_tiles");
+	LOG_INFO("Model", "Loading {} tiles...", tiles.size());
+	auto start_time = chrono::steady_clock::now();
+
+	vector<unique_ptr<Model>> tile_models(tiles.size());
+	atomic<size_t> next_tile = 0;
+	auto worker = [&]() {
+		for (size_t i = next_tile++; i < tiles.size(); i = next_tile++) {
+			tile_models[i] = unique_ptr<Model>(new Model(tiles[i], layers_));
+		}
+	};
+
+	size_t thread_count = std::min<size_t>(tiles.size(), std::max(1u, thread::hardware_concurrency()));
+	vector<thread> workers;
+	for (size_t i = 0; i < thread_count; i++) {
+		workers.emplace_back(worker);
+	}
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	for (size_t i = 0; i < tiles.size(); i++) {
+		if (!tile_models[i]->WasModelCreated()) {
+			string tile_name = tiles[i].filename.empty() ? "#" + to_string(i) : "'" + tiles[i].filename + "'";
+			LOG_ERROR("Model", "Error: Failed to parse tile {}.", tile_name);
+			return false;
+		}
+		Merge(*tile_models[i]);
+	}
+	// The rings of relations whose members are spread over several tiles can only be stitched now.
+	{
+		METRICS_SCOPE("model.build_rings");
+		for (const auto& [id, record] : relation_id_to_record_) {
+			RebuildRelation(record);
+		}
+	}
+
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+	LOG_INFO("Model", "Merged {} tiles into {} nodes and {} ways in {} ms.", tiles.size(), nodes_.size(), ways_.size(), elapsed.count());
+	return true;
+}
+
+// Merges a parsed, unprojected tile into this model. Nodes, ways and relations that are already present
+// (because they cross a tile border) are identified by their OSM id and kept only once.
+void Model::Merge(const Model& tile) {
+	if (!bounds_parsed_) {
+		min_lat_ = tile.min_lat_;
+		max_lat_ = tile.max_lat_;
+		min_lon_ = tile.min_lon_;
+		max_lon_ = tile.max_lon_;
+		bounds_parsed_ = true;
+	}
+	else {
+		min_lat_ = std::min(min_lat_, tile.min_lat_);
+		max_lat_ = std::max(max_lat_, tile.max_lat_);
+		min_lon_ = std::min(min_lon_, tile.min_lon_);
+		max_lon_ = std::max(max_lon_, tile.max_lon_);
+	}
+
+	vector<const string*> node_ids(tile.nodes_.size(), nullptr);
+	for (const auto& [id, number] : tile.node_id_to_number_) {
+		node_ids[number] = &id;
+	}
+	vector<int> node_remap(tile.nodes_.size(), -1);
+	for (size_t i = 0; i < tile.nodes_.size(); i++) {
+		if (node_ids[i] == nullptr) {
+			continue;
+		}
+		if (auto it = node_id_to_number_.find(*node_ids[i]); it != node_id_to_number_.end()) {
+			node_remap[i] = it->second;
+		}
+		else {
+			node_remap[i] = (int)nodes_.size();
+			node_id_to_number_[*node_ids[i]] = node_remap[i];
+			nodes_.emplace_back(tile.nodes_[i]);
+		}
+	}
+
+	auto append_way = [&](int tile_way) {
+		int number = (int)ways_.size();
+		auto& way = ways_.emplace_back();
+		for (auto node_number : tile.ways_[tile_way].nodes) {
+			if (node_remap[node_number] != -1) {
+				way.nodes.emplace_back(node_remap[node_number]);
+			}
+		}
+		return number;
+	};
+
+	vector<const string*> way_ids(tile.ways_.size(), nullptr);
+	for (const auto& [id, number] : tile.way_id_to_number_) {
+		way_ids[number] = &id;
+	}
+	vector<int> way_remap(tile.ways_.size(), -1);
+	vector<bool> duplicate_way(tile.ways_.size(), false);
+	for (size_t i = 0; i < tile.ways_.size(); i++) {
+		if (way_ids[i] == nullptr) {
+			continue;
+		}
+		if (auto it = way_id_to_number_.find(*way_ids[i]); it != way_id_to_number_.end()) {
+			way_remap[i] = it->second;
+			duplicate_way[i] = true;
+		}
+		else {
+			way_remap[i] = append_way(i);
+			way_id_to_number_[*way_ids[i]] = way_remap[i];
+		}
+	}
+
+	// Rings stitched by BuildRings have no OSM id; they are only copied when a merged relation uses them.
+	auto map_way = [&](int tile_way) {
+		if (way_remap[tile_way] == -1) {
+			way_remap[tile_way] = append_way(tile_way);
+		}
+		return way_remap[tile_way];
+	};
+	auto map_ways = [&](vector<int>& way_numbers) {
+		for (auto& way_number : way_numbers) {
+			way_number = map_way(way_number);
+		}
+	};
+
+	for (const auto& road : tile.roads_) {
+		if (!duplicate_way[road.way]) {
+			roads_.emplace_back(road).way = way_remap[road.way];
+		}
+	}
+	for (const auto& railway : tile.railways_) {
+		if (!duplicate_way[railway.way]) {
+			railways_.emplace_back(railway).way = way_remap[railway.way];
+		}
+	}
+
+	auto add_members = [](vector<int>& members, const vector<int>& tile_members) {
+		for (int way_number : tile_members) {
+			if (std::find(members.begin(), members.end(), way_number) == members.end()) {
+				members.emplace_back(way_number);
+			}
+		}
+	};
+
+	map<pair<LayerFlags, int>, const string*> relation_features;
+	for (const auto& [id, record] : tile.relation_id_to_record_) {
+		relation_features[{ record.feature.layer, record.feature.index }] = &id;
+	}
+	auto merge_features = [&](auto& features, const auto& tile_features, LayerFlags layer) {
+		for (size_t i = 0; i < tile_features.size(); i++) {
+			const auto& feature = tile_features[i];
+			if (auto it = relation_features.find({ layer, (int)i }); it != relation_features.end()) {
+				const auto& id = *it->second;
+				auto record = tile.relation_id_to_record_.at(id);
+				map_ways(record.outer);
+				map_ways(record.inner);
+				// A tile only lists the members it holds; the others are added from the tiles that hold them.
+				if (auto existing = relation_id_to_record_.find(id); existing != relation_id_to_record_.end()) {
+					add_members(existing->second.outer, record.outer);
+					add_members(existing->second.inner, record.inner);
+					continue;
+				}
+				record.feature.index = (int)features.size();
+				relation_id_to_record_[id] = std::move(record);
+			}
+			else if (feature.outer.empty() || duplicate_way[feature.outer.front()]) {
+				continue;
+			}
+			auto& merged = features.emplace_back(feature);
+			map_ways(merged.outer);
+			map_ways(merged.inner);
+		}
+	};
+	merge_features(buildings_, tile.buildings_, LayerFlags::BUILDINGS);
+	merge_features(leisures_, tile.leisures_, LayerFlags::LEISURES);
+	merge_features(waters_, tile.waters_, LayerFlags::WATERS);
+	merge_features(landuses_, tile.landuses_, LayerFlags::LANDUSES);
 }
 
 void Model::PrintData() {
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Printing roads...", true);
+	LOG_INFO("Model", "Printing roads...");
+	Logger::Flush();
 	for (int i = 0; i < roads_.size(); i++) {
 		cout << "road[" << i << "].way: " << roads_[i].way << endl;
 		cout << "road[" << i << "].type: " << roads_[i].type << endl;
 		cout << endl;
 	}
 
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Printing ways...", true);
+	LOG_INFO("Model", "Printing ways...");
+	Logger::Flush();
 	for (int i = 0; i < ways_.size(); i++) {
 		cout << "way[" << i << "]:" << endl;
 		for (auto it = ways_[i].nodes.begin(); it != ways_[i].nodes.end(); it++) {
@@ -73,7 +375,8 @@ void Model::PrintData() {
 		cout << endl;
 	}
 
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Printing node_number_to_road_numbers values...", true);
+	LOG_INFO("Model", "Printing node_number_to_road_numbers values...");
+	Logger::Flush();
 	for (int index = 0; index < nodes_.size(); index++) {
 		if (auto it = node_number_to_road_numbers_.find(index); it != node_number_to_road_numbers_.end()) {
 			cout << "node: " << index << endl;
@@ -85,59 +388,122 @@ void Model::PrintData() {
 }
 
 xml_parse_result Model::OpenDocument(AppData* data) {
+	METRICS_SCOPE("model.open_document");
 	xml_parse_result result;
 	errno_t err = NULL;
 
 	switch (data->sm) {
 	case StorageMethod::FILE_STORAGE:
 		CloseFile(data->query_file);
-		result = doc_.load_file(data->query_file->filename.c_str());
+		result = LoadDocument(doc_, data->query_file->filename, doc_buffer_);
 		break;
 	case StorageMethod::MEMORY_STORAGE:
-		string memory = data->query_data->memory;
 		result = doc_.load_buffer(data->query_data->memory, data->query_data->size);
 		break;
+	default:
+		break;
 	}
 	return result;
 }
 
 void Model::ParseData(AppData* data) {
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Parsing data...", false);
-
-	ParseBounds();
+	METRICS_SCOPE("model.parse_data");
+	LOG_DEBUG("Model", "Parsing data...");
+	auto start_time = chrono::steady_clock::now();
 
 	int index;
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Parsing nodes...", false);
-	for (const xpath_node& node : doc_.select_nodes("/osm/node")) {
-		ParseNode(node.node(), index);
+	for (const xml_node& element : doc_.child("osm").children()) {
+		ParseElement(element, index);
 	}
 
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Parsing ways...", false);
-	for (const xpath_node& way : doc_.select_nodes("/osm/way")) {
-		ParseNode(way.node(), index);
+	CompleteParsing(start_time);
+}
+
+// Parses the document batch by batch while it is still being received, so that parsing overlaps the download.
+// On failure the stream is cancelled, which stops its producer.
+bool Model::ParseStream(OSMStream* stream) {
+	METRICS_SCOPE("model.parse_stream");
+	LOG_DEBUG("Model", "Parsing data from stream...");
+	auto start_time = chrono::steady_clock::now();
 
-		for (const xpath_node& child : way.node().children()) {
-			ParseAttributes(child.node(), index);
+	int index;
+	int batches = 0;
+	string batch;
+	while (stream->NextBatch(batch)) {
+		xml_document batch_doc;
+		if (!batch_doc.load_buffer_inplace(batch.data(), batch.size())) {
+			stream->Cancel();
+			return false;
 		}
+		for (const xml_node& element : batch_doc.child("osm").children()) {
+			ParseElement(element, index);
+		}
+		batches++;
 	}
 
-	for (const xpath_node& relation : doc_.select_nodes("/osm/relation")) {
-		ParseRelations(relation.node(), index);
+	if (!stream->IsComplete()) {
+		LOG_ERROR("Model", "Error: The stream ended before the document was complete.");
+		stream->Cancel();
+		return false;
 	}
+	LOG_INFO("Model", "Parsed {} bytes in {} batches.", stream->GetBytesReceived(), batches);
+	CompleteParsing(start_time);
+	return true;
 }
 
-void Model::ParseBounds() {
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Parsing bounds...", false);
-	if (auto bounds = doc_.select_nodes("/osm/bounds"); !bounds.empty()) {
-		auto node = bounds.first().node();
-		min_lat_ = node.attribute("minlat").as_double();
-		max_lat_ = node.attribute("maxlat").as_double();
-		min_lon_ = node.attribute("minlon").as_double();
-		max_lon_ = node.attribute("maxlon").as_double();
+void Model::ParseElement(const xml_node& element, int& index) {
+	auto name = string_view{ element.name() };
+
+	if (name == "node") {
+		ParseNode(element, index);
 	}
-	else {
+	else if (name == "way") {
+		if (!IsWaySelected(element)) {
+			skipped_ways_++;
+			return;
+		}
+		ParseNode(element, index);
+
+		for (const xml_node& child : element.children()) {
+			ParseAttributes(child, index);
+		}
+	}
+	else if (name == "relation") {
+		using L = LayerFlags;
+		if (IsLayerSelected((int)L::BUILDINGS | (int)L::LANDUSES | (int)L::WATERS)) {
+			ParseRelations(element, index);
+		}
+	}
+	else if (name == "bounds") {
+		ParseBounds(element);
+	}
+}
+
+void Model::CompleteParsing(chrono::steady_clock::time_point start_time) {
+	if (!bounds_parsed_) {
 		throw std::logic_error("map's bounds are not defined.");
 	}
+	BuildPendingRings();
+
+	if (layers_ != (unsigned int)LayerFlags::ALL) {
+		LOG_INFO("Model", "Skipped {} ways outside the selected layers.", skipped_ways_);
+		CompactNodes();
+	}
+
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+	LOG_INFO("Model", "Parsed {} nodes and {} ways in {} ms.", nodes_.size(), ways_.size(), elapsed.count());
+	METRICS_COUNT("model.nodes_parsed", nodes_.size());
+	METRICS_COUNT("model.ways_parsed", ways_.size());
+	METRICS_GAUGE("model.parse_rate_nodes_per_s", nodes_.size() / std::max(1e-3, chrono::duration<double>(chrono::steady_clock::now() - start_time).count()));
+}
+
+void Model::ParseBounds(const xml_node& bounds) {
+	LOG_DEBUG("Model", "Parsing bounds...");
+	min_lat_ = bounds.attribute("minlat").as_double();
+	max_lat_ = bounds.attribute("maxlat").as_double();
+	min_lon_ = bounds.attribute("minlon").as_double();
+	max_lon_ = bounds.attribute("maxlon").as_double();
+	bounds_parsed_ = true;
 }
 
 void Model::ParseNode(const xml_node& node, int &index) {
@@ -163,19 +529,37 @@ void Model::ParseNode(const xml_node& node, int &index) {
 	}
 }
 
+bool Model::IsWaySelected(const xml_node& way) const {
+	using L = LayerFlags;
+	// Untagged ways may be members of multipolygon relations, so they are only dropped when no relation layer is loaded.
+	if (IsLayerSelected((int)L::BUILDINGS | (int)L::LANDUSES | (int)L::WATERS)) {
+		return true;
+	}
+	for (auto child : way.children("tag")) {
+		if (IsLayerSelected(TagToLayer(child.attribute("k").as_string(), child.attribute("v").as_string()))) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void Model::ParseAttributes(const xml_node& node, int index) {
 	string_view name = string_view{ node.name() };
 
 	if (name == "nd") {
 		auto ref = node.attribute("ref").as_string();
 		if (auto it = node_id_to_number_.find(ref); it != std::end(node_id_to_number_)) {
-			ways_.back().nodes.emplace_back(it->second);
+			ways_[index].nodes.emplace_back(it->second);
 		}
 	}
 	else if (name == "tag") {
 		auto category = string_view{ node.attribute("k").as_string() };
 		auto type = string_view{ node.attribute("v").as_string() };
 
+		if (!IsLayerSelected(TagToLayer(category, type))) {
+			return;
+		}
+
 		if (category == "highway") {
 			if (auto road_type = StringToRoadType(type); road_type != Road::Invalid) {
 				roads_.emplace_back();
@@ -225,7 +609,8 @@ void Model::ParseAttributes(const xml_node& node, int index) {
 void Model::ParseRelations(const xpath_node& relation, int& index) {
 	auto node = relation.node();
 	std::vector<int> outer, inner;
-	auto commit = [&](Multipolygon& mp) {
+	auto commit = [&](Multipolygon& mp, LayerFlags layer, int feature_index) {
+		relation_id_to_record_[node.attribute("id").as_string()] = { { layer, feature_index }, outer, inner };
 		mp.outer = std::move(outer);
 		mp.inner = std::move(inner);
 	};
@@ -245,20 +630,26 @@ void Model::ParseRelations(const xpath_node& relation, int& index) {
 		else if (name == "tag") {
 			auto category = std::string_view{ child.attribute("k").as_string() };
 			auto type = std::string_view{ child.attribute("v").as_string() };
+			if (!IsLayerSelected(TagToLayer(category, type))) {
+				continue;
+			}
 			if (category == "building") {
-				commit(buildings_.emplace_back());
+				buildings_.emplace_back();
+				commit(buildings_.back(), LayerFlags::BUILDINGS, (int)buildings_.size() - 1);
 				break;
 			}
 			if (category == "natural" && type == "water") {
-				commit(waters_.emplace_back());
-				BuildRings(waters_.back());
+				waters_.emplace_back();
+				commit(waters_.back(), LayerFlags::WATERS, (int)waters_.size() - 1);
+				unstitched_features_.push_back({ LayerFlags::WATERS, (int)waters_.size() - 1 });
 				break;
 			}
 			if (category == "landuse") {
 				if (auto landuse_type = StringToLanduseType(type); landuse_type != Landuse::Invalid) {
-					commit(landuses_.emplace_back());
+					landuses_.emplace_back();
+					commit(landuses_.back(), LayerFlags::LANDUSES, (int)landuses_.size() - 1);
 					landuses_.back().type = landuse_type;
-					BuildRings(landuses_.back());
+					unstitched_features_.push_back({ LayerFlags::LANDUSES, (int)landuses_.size() - 1 });
 				}
 				break;
 			}
@@ -266,8 +657,48 @@ void Model::ParseRelations(const xpath_node& relation, int& index) {
 	}
 }
 
+// Drops every node that is not referenced by a loaded way and renumbers the remaining ones.
+void Model::CompactNodes() {
+	vector<int> node_number_remap(nodes_.size(), -1);
+	for (const auto& way : ways_) {
+		for (auto node_number : way.nodes) {
+			node_number_remap[node_number] = 0;
+		}
+	}
+
+	vector<Node> compacted_nodes;
+	for (int i = 0; i < nodes_.size(); i++) {
+		if (node_number_remap[i] != -1) {
+			node_number_remap[i] = (int)compacted_nodes.size();
+			compacted_nodes.emplace_back(nodes_[i]);
+		}
+	}
+
+	for (auto& way : ways_) {
+		for (auto& node_number : way.nodes) {
+			node_number = node_number_remap[node_number];
+		}
+	}
+
+	for (auto it = node_id_to_number_.begin(); it != node_id_to_number_.end();) {
+		if (auto number = node_number_remap[it->second]; number != -1) {
+			it->second = number;
+			++it;
+		}
+		else {
+			it = node_id_to_number_.erase(it);
+		}
+	}
+
+	auto removed_nodes = nodes_.size() - compacted_nodes.size();
+	auto saved_bytes = removed_nodes * (sizeof(Node) + sizeof(pair<const string, int>));
+	nodes_ = std::move(compacted_nodes);
+	LOG_INFO("Model", "Compacted away {} unreferenced nodes (~{} KiB saved).", removed_nodes, saved_bytes / 1024);
+}
+
 void Model::CreateRoadGraph() {
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Creating map of nodes to roads...", false);
+	METRICS_SCOPE("model.create_road_graph");
+	LOG_DEBUG("Model", "Creating map of nodes to roads...");
 	sort(roads_.begin(), roads_.end(), [](const auto& _1st, const auto& _2nd) {
 		return (int)_1st.type < (int)_2nd.type;
 	});
@@ -279,61 +710,79 @@ void Model::CreateRoadGraph() {
 	}
 }
 
-static bool TrackRec(const std::vector<int>& open_ways,
-	const Model::Way* ways,
-	std::vector<bool>& used,
-	std::vector<int>& nodes)
-{
-	if (nodes.empty()) {
-		for (int i = 0; i < open_ways.size(); ++i)
-			if (!used[i]) {
-				used[i] = true;
-				const auto& way_nodes = ways[open_ways[i]].nodes;
-				nodes = way_nodes;
-				if (TrackRec(open_ways, ways, used, nodes))
-					return true;
-				nodes.clear();
-				used[i] = false;
-			}
-		return false;
+static void AppendWayToRing(std::vector<int>& ring, const std::vector<int>& way_nodes, bool reversed) {
+	if (reversed) {
+		ring.insert(ring.end(), way_nodes.rbegin() + 1, way_nodes.rend());
 	}
 	else {
-		const auto head = nodes.front();
-		const auto tail = nodes.back();
-		if (head == tail && nodes.size() > 1)
-			return true;
-		for (int i = 0; i < open_ways.size(); ++i)
-			if (!used[i]) {
-				const auto& way_nodes = ways[open_ways[i]].nodes;
-				const auto way_head = way_nodes.front();
-				const auto way_tail = way_nodes.back();
-				if (way_head == tail || way_tail == tail) {
-					used[i] = true;
-					const auto len = nodes.size();
-					if (way_head == tail)
-						nodes.insert(nodes.end(), way_nodes.begin(), way_nodes.end());
-					else
-						nodes.insert(nodes.end(), way_nodes.rbegin(), way_nodes.rend());
-					if (TrackRec(open_ways, ways, used, nodes))
-						return true;
-					nodes.resize(len);
-					used[i] = false;
-				}
-			}
-		return false;
+		ring.insert(ring.end(), way_nodes.begin() + 1, way_nodes.end());
 	}
 }
 
-static std::vector<int> Track(std::vector<int>& open_ways, const Model::Way* ways)
+// Stitches the open ways of a multipolygon into closed rings. Way endpoints are indexed once in
+// a hash map, so every way is visited a constant number of times and the whole pass is linear.
+// Chains that cannot be closed are counted in unclosed_rings and dropped.
+static std::vector<std::vector<int>> StitchRings(const std::vector<int>& open_ways, const Model::Way* ways, int& unclosed_rings)
 {
-	assert(!open_ways.empty());
+	std::unordered_map<int, std::vector<int>> endpoints;
+	for (int i = 0; i < open_ways.size(); ++i) {
+		const auto& way_nodes = ways[open_ways[i]].nodes;
+		endpoints[way_nodes.front()].emplace_back(i);
+		endpoints[way_nodes.back()].emplace_back(i);
+	}
+
+	auto take_way_at = [&](int node) {
+		auto it = endpoints.find(node);
+		if (it == endpoints.end()) {
+			return -1;
+		}
+		return it->second.empty() ? -1 : it->second.back();
+	};
+
 	std::vector<bool> used(open_ways.size(), false);
-	std::vector<int> nodes;
-	if (TrackRec(open_ways, ways, used, nodes))
-		for (int i = 0; i < open_ways.size(); ++i)
-			if (used[i])
-				open_ways[i] = -1;
-	return nodes;
+	auto release = [&](int i) {
+		used[i] = true;
+		const auto& way_nodes = ways[open_ways[i]].nodes;
+		for (auto node : { way_nodes.front(), way_nodes.back() }) {
+			auto& slots = endpoints[node];
+			slots.erase(std::remove(slots.begin(), slots.end(), i), slots.end());
+		}
+	};
+
+	std::vector<std::vector<int>> rings;
+	unclosed_rings = 0;
+	for (int i = 0; i < open_ways.size(); ++i) {
+		if (used[i]) {
+			continue;
+		}
+		release(i);
+		std::vector<int> ring = ways[open_ways[i]].nodes;
+		while (ring.front() != ring.back()) {
+			auto next = take_way_at(ring.back());
+			if (next == -1) {
+				break;
+			}
+			release(next);
+			const auto& way_nodes = ways[open_ways[next]].nodes;
+			AppendWayToRing(ring, way_nodes, way_nodes.front() != ring.back());
+		}
+		if (ring.size() > 1 && ring.front() == ring.back()) {
+			rings.emplace_back(std::move(ring));
+		}
+		else {
+			unclosed_rings++;
+		}
+	}
+	return rings;
+}
+
+// Stitches the rings of the relations parsed since the last call, as one stage.
+void Model::BuildPendingRings() {
+	METRICS_SCOPE("model.build_rings");
+	for (auto feature : unstitched_features_) {
+		BuildRings(*GetMultipolygon(feature));
+	}
+	unstitched_features_.clear();
 }
 
 void Model::BuildRings(Multipolygon& mp)
@@ -343,21 +792,33 @@ void Model::BuildRings(Multipolygon& mp)
 	};
 
 	auto process = [&](std::vector<int>& ways_nums) {
-		auto ways = ways_.data();
 		std::vector<int> closed, open;
 
-		for (auto& way_num : ways_nums)
-			(is_closed(ways[way_num]) ? closed : open).emplace_back(way_num);
+		for (auto& way_num : ways_nums) {
+			if (ways_[way_num].nodes.empty()) {
+				continue;
+			}
+			(is_closed(ways_[way_num]) ? closed : open).emplace_back(way_num);
+		}
 
-		while (!open.empty()) {
-			auto new_nodes = Track(open, ways);
-			if (new_nodes.empty())
-				break;
-			open.erase(std::remove_if(open.begin(), open.end(), [](auto v) {return v < 0; }), open.end());
-			closed.emplace_back((int)ways_.size());
-			Model::Way new_way;
-			new_way.nodes = std::move(new_nodes);
-			ways_.emplace_back(new_way);
+		if (!open.empty()) {
+			int unclosed_rings = 0;
+			auto rings = StitchRings(open, ways_.data(), unclosed_rings);
+			for (auto& ring : rings) {
+				int way_number = (int)ways_.size();
+				if (free_ring_ways_.empty()) {
+					ways_.emplace_back();
+				}
+				else {
+					way_number = free_ring_ways_.back();
+					free_ring_ways_.pop_back();
+				}
+				ways_[way_number].nodes = std::move(ring);
+				closed.emplace_back(way_number);
+			}
+			if (unclosed_rings > 0) {
+				LOG_WARNING("Model", "Warning: {} unclosed ring(s) dropped from multipolygon.", unclosed_rings);
+			}
 		}
 		std::swap(ways_nums, closed);
 	};
@@ -366,15 +827,353 @@ void Model::BuildRings(Multipolygon& mp)
 	process(mp.inner);
 }
 
+// Applies an osmChange (.osc) document to the loaded model. Only the nodes, ways and relations named in the
+// change are touched; the road graph is patched in place and replaced features are left as empty tombstones
+// so that the indices held by the renderer and the pathfinder stay valid.
+bool Model::ApplyChange(const string& filename) {
+	LOG_INFO("Model", "Applying changes from '{}'...", filename);
+	auto start_time = chrono::steady_clock::now();
+
+	xml_document change_doc;
+	vector<char> change_buffer;
+	if (!LoadDocument(change_doc, filename, change_buffer)) {
+		LOG_ERROR("Model", "Error: Failed to parse the change file.");
+		return false;
+	}
+
+	BuildFeatureIndex();
+
+	int changes = 0;
+	for (const xml_node& action_node : change_doc.child("osmChange").children()) {
+		auto action = string_view{ action_node.name() };
+		if (action != "create" && action != "modify" && action != "delete") {
+			continue;
+		}
+		for (const xml_node& element : action_node.children()) {
+			auto name = string_view{ element.name() };
+			if (name == "node") {
+				ApplyNodeChange(action, element);
+			}
+			else if (name == "way") {
+				ApplyWayChange(action, element);
+			}
+			else if (name == "relation") {
+				ApplyRelationChange(action, element);
+			}
+			else {
+				continue;
+			}
+			changes++;
+		}
+	}
+
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+	LOG_INFO("Model", "Applied {} changes in {} ms.", changes, elapsed.count());
+	return true;
+}
+
+void Model::ApplyNodeChange(string_view action, const xml_node& element) {
+	string id = element.attribute("id").as_string();
+	auto it = node_id_to_number_.find(id);
+	if (action == "delete") {
+		if (it != node_id_to_number_.end()) {
+			node_id_to_number_.erase(it);
+		}
+		return;
+	}
+
+	int index;
+	if (it == node_id_to_number_.end()) {
+		ParseNode(element, index);
+	}
+	else {
+		index = it->second;
+		nodes_[index].x = element.attribute("lon").as_double();
+		nodes_[index].y = element.attribute("lat").as_double();
+	}
+	ProjectNode(nodes_[index]);
+}
+
+void Model::ApplyWayChange(string_view action, const xml_node& element) {
+	string id = element.attribute("id").as_string();
+	if (auto it = way_id_to_number_.find(id); it != way_id_to_number_.end()) {
+		int index = it->second;
+		RemoveWayFeatures(index);
+		ways_[index].nodes.clear();
+		if (action == "delete") {
+			way_id_to_number_.erase(it);
+		}
+		else {
+			ParseWayFeatures(element, index);
+		}
+		RebuildRelations(index);
+	}
+	else if (action != "delete" && IsWaySelected(element)) {
+		int index;
+		ParseNode(element, index);
+		ParseWayFeatures(element, index);
+	}
+}
+
+void Model::ApplyRelationChange(string_view action, const xml_node& element) {
+	RemoveRelation(element.attribute("id").as_string());
+	using L = LayerFlags;
+	if (action != "delete" && IsLayerSelected((int)L::BUILDINGS | (int)L::LANDUSES | (int)L::WATERS)) {
+		int index;
+		ParseRelations(element, index);
+		BuildPendingRings();
+	}
+}
+
+// Parses the node references and tags of a way into ways_[index] and registers the features it creates.
+void Model::ParseWayFeatures(const xml_node& way, int index) {
+	const auto roads = roads_.size();
+	const auto railways = railways_.size();
+	const auto buildings = buildings_.size();
+	const auto leisures = leisures_.size();
+	const auto waters = waters_.size();
+	const auto landuses = landuses_.size();
+
+	for (const xml_node& child : way.children()) {
+		ParseAttributes(child, index);
+	}
+
+	auto& features = way_number_to_features_[index];
+	auto register_features = [&](LayerFlags layer, size_t from, size_t to) {
+		for (size_t i = from; i < to; i++) {
+			features.push_back({ layer, (int)i });
+		}
+	};
+	register_features(LayerFlags::ROADS, roads, roads_.size());
+	register_features(LayerFlags::RAILWAYS, railways, railways_.size());
+	register_features(LayerFlags::BUILDINGS, buildings, buildings_.size());
+	register_features(LayerFlags::LEISURES, leisures, leisures_.size());
+	register_features(LayerFlags::WATERS, waters, waters_.size());
+	register_features(LayerFlags::LANDUSES, landuses, landuses_.size());
+	for (size_t i = roads; i < roads_.size(); i++) {
+		AddRoadToGraph((int)i);
+	}
+}
+
+void Model::RemoveWayFeatures(int index) {
+	auto it = way_number_to_features_.find(index);
+	if (it == way_number_to_features_.end()) {
+		return;
+	}
+	for (auto feature : it->second) {
+		switch (feature.layer) {
+		case LayerFlags::ROADS:
+			RemoveRoadFromGraph(feature.index);
+			roads_[feature.index].type = Road::Invalid;
+			break;
+		case LayerFlags::RAILWAYS:
+			railways_[feature.index].way = -1;
+			break;
+		default:
+			if (auto mp = GetMultipolygon(feature); mp != nullptr) {
+				mp->outer.clear();
+				mp->inner.clear();
+			}
+			break;
+		}
+	}
+	way_number_to_features_.erase(it);
+}
+
+void Model::RemoveRelation(const string& id) {
+	auto it = relation_id_to_record_.find(id);
+	if (it == relation_id_to_record_.end()) {
+		return;
+	}
+	if (auto mp = GetMultipolygon(it->second.feature); mp != nullptr) {
+		ReleaseRingWays(it->second, *mp);
+		mp->outer.clear();
+		mp->inner.clear();
+	}
+	relation_id_to_record_.erase(it);
+}
+
+// Restitches the rings of every relation that has way_number as a member.
+void Model::RebuildRelations(int way_number) {
+	auto contains = [way_number](const vector<int>& members) {
+		return std::find(members.begin(), members.end(), way_number) != members.end();
+	};
+	for (auto& [id, record] : relation_id_to_record_) {
+		if (!contains(record.outer) && !contains(record.inner)) {
+			continue;
+		}
+		RebuildRelation(record);
+	}
+}
+
+// Restitches the rings of a relation's multipolygon from its member ways.
+void Model::RebuildRelation(const RelationRecord& record) {
+	auto mp = GetMultipolygon(record.feature);
+	ReleaseRingWays(record, *mp);
+	mp->outer = record.outer;
+	mp->inner = record.inner;
+	if (record.feature.layer != LayerFlags::BUILDINGS) {
+		BuildRings(*mp);
+	}
+}
+
+// Empties the ways that BuildRings stitched for a relation, which are not members of it, and keeps them
+// for reuse by the next BuildRings, so that applying changes does not pile up ring ways.
+void Model::ReleaseRingWays(const RelationRecord& record, const Multipolygon& mp) {
+	auto is_member = [&record](int way_number) {
+		return std::find(record.outer.begin(), record.outer.end(), way_number) != record.outer.end() ||
+			std::find(record.inner.begin(), record.inner.end(), way_number) != record.inner.end();
+	};
+	for (const auto* ways : { &mp.outer, &mp.inner }) {
+		for (int way_number : *ways) {
+			if (!is_member(way_number)) {
+				ways_[way_number].nodes.clear();
+				free_ring_ways_.emplace_back(way_number);
+			}
+		}
+	}
+}
+
+// Indexes the features that were created from each way's own tags. The index is only needed to apply
+// changes, so it is built on demand.
+void Model::BuildFeatureIndex() {
+	if (feature_index_built_) {
+		return;
+	}
+
+	set<pair<LayerFlags, int>> relation_features;
+	for (const auto& [id, record] : relation_id_to_record_) {
+		relation_features.emplace(record.feature.layer, record.feature.index);
+	}
+
+	for (size_t i = 0; i < roads_.size(); i++) {
+		if (roads_[i].type != Road::Invalid) {
+			way_number_to_features_[roads_[i].way].push_back({ LayerFlags::ROADS, (int)i });
+		}
+	}
+	for (size_t i = 0; i < railways_.size(); i++) {
+		way_number_to_features_[railways_[i].way].push_back({ LayerFlags::RAILWAYS, (int)i });
+	}
+
+	auto index_multipolygons = [&](const auto& features, LayerFlags layer) {
+		for (size_t i = 0; i < features.size(); i++) {
+			if (features[i].outer.size() == 1 && features[i].inner.empty() && !relation_features.count({ layer, (int)i })) {
+				way_number_to_features_[features[i].outer.front()].push_back({ layer, (int)i });
+			}
+		}
+	};
+	index_multipolygons(buildings_, LayerFlags::BUILDINGS);
+	index_multipolygons(leisures_, LayerFlags::LEISURES);
+	index_multipolygons(waters_, LayerFlags::WATERS);
+	index_multipolygons(landuses_, LayerFlags::LANDUSES);
+
+	feature_index_built_ = true;
+}
+
+Model::Multipolygon* Model::GetMultipolygon(FeatureRef feature) {
+	switch (feature.layer) {
+	case LayerFlags::BUILDINGS: return &buildings_[feature.index];
+	case LayerFlags::LEISURES:  return &leisures_[feature.index];
+	case LayerFlags::WATERS:    return &waters_[feature.index];
+	case LayerFlags::LANDUSES:  return &landuses_[feature.index];
+	default:                    return nullptr;
+	}
+}
+
+void Model::AddRoadToGraph(int road_number) {
+	for (auto node_number : ways_[roads_[road_number].way].nodes) {
+		node_number_to_road_numbers_[node_number].emplace_back(road_number);
+	}
+}
+
+void Model::RemoveRoadFromGraph(int road_number) {
+	for (auto node_number : ways_[roads_[road_number].way].nodes) {
+		if (auto it = node_number_to_road_numbers_.find(node_number); it != node_number_to_road_numbers_.end()) {
+			auto& road_numbers = it->second;
+			road_numbers.erase(std::remove(road_numbers.begin(), road_numbers.end(), road_number), road_numbers.end());
+			if (road_numbers.empty()) {
+				node_number_to_road_numbers_.erase(it);
+			}
+		}
+	}
+}
+
+// Describes the road graph and the number of features per layer in terms of OSM ids, so that two models
+// built in different ways (e.g. patched and rebuilt) can be compared independently of their numbering.
+vector<string> Model::DescribeRoadGraph() const {
+	vector<string> node_ids(nodes_.size());
+	vector<string> way_ids(ways_.size());
+	for (const auto& [id, number] : node_id_to_number_) {
+		node_ids[number] = id;
+	}
+	for (const auto& [id, number] : way_id_to_number_) {
+		way_ids[number] = id;
+	}
+
+	vector<string> lines;
+	for (const auto& road : roads_) {
+		if (road.type == Road::Invalid) {
+			continue;
+		}
+		string line = "road " + way_ids[road.way] + " " + to_string(road.type) + " " + road.name + ":";
+		for (auto node_number : ways_[road.way].nodes) {
+			line += " " + node_ids[node_number];
+		}
+		lines.emplace_back(std::move(line));
+	}
+
+	for (const auto& [node_number, road_numbers] : node_number_to_road_numbers_) {
+		ostringstream line;
+		line << std::fixed << std::setprecision(9) << "node " << node_ids[node_number] << " "
+			<< nodes_[node_number].x << " " << nodes_[node_number].y << " " << road_numbers.size();
+		lines.emplace_back(line.str());
+	}
+
+	auto count_live = [](const auto& features) {
+		return to_string(std::count_if(features.begin(), features.end(), [](const auto& mp) { return !mp.outer.empty(); }));
+	};
+	lines.emplace_back("buildings " + count_live(buildings_));
+	lines.emplace_back("leisures " + count_live(leisures_));
+	lines.emplace_back("waters " + count_live(waters_));
+	lines.emplace_back("landuses " + count_live(landuses_));
+	lines.emplace_back("railways " + to_string(std::count_if(railways_.begin(), railways_.end(), [](const auto& railway) { return railway.way >= 0; })));
+
+	sort(lines.begin(), lines.end());
+	return lines;
+}
+
+bool Model::MatchesRoadGraph(const Model& other) const {
+	auto lines = DescribeRoadGraph();
+	auto other_lines = other.DescribeRoadGraph();
+	if (lines == other_lines) {
+		return true;
+	}
+
+	vector<string> differences;
+	set_symmetric_difference(lines.begin(), lines.end(), other_lines.begin(), other_lines.end(), back_inserter(differences));
+	for (size_t i = 0; i < differences.size() && i < 10; i++) {
+		LOG_INFO("Model", "Difference: {}", differences[i]);
+	}
+	return false;
+}
+
+static const double PI = 3.14159265358979323846264338327950288;
+static const double DEG_TO_RAD = 2. * PI / 360.;
+static const double EARTH_RADIUS = 6378137.0;
+
+static double LatToMeters(double lat) {
+	return log(tan(lat * DEG_TO_RAD / 2 + PI / 4)) / 2 * EARTH_RADIUS;
+}
+
+static double LonToMeters(double lon) {
+	return lon * DEG_TO_RAD / 2 * EARTH_RADIUS;
+}
+
 void Model::AdjustCoordinates(AppData* data) {
-	PrintDebugMessage(APPLICATION_NAME, "Model", "Projecting node coordinates to cartesian coordinate system...", false);
-	const auto pi = 3.14159265358979323846264338327950288;
-	const auto deg_to_rad = 2. * pi / 360.;
-	const auto earth_radius = 6378137.0;
-	const auto lat2ym = [&](double lat) { return log(tan(lat * deg_to_rad / 2 + pi / 4)) / 2 * earth_radius; };
-	const auto lon2xm = [&](double lon) { return lon * deg_to_rad / 2 * earth_radius; };
-	const auto dx = lon2xm(max_lon_) - lon2xm(min_lon_);
-	const auto dy = lat2ym(max_lat_) - lat2ym(min_lat_);
+	METRICS_SCOPE("model.adjust_coordinates");
+	LOG_DEBUG("Model", "Projecting node coordinates to cartesian coordinate system...");
+	const auto dx = LonToMeters(max_lon_) - LonToMeters(min_lon_);
+	const auto dy = LatToMeters(max_lat_) - LatToMeters(min_lat_);
 
 	if (data->use_aspect_ratio) {
 		aspect_ratio_ = dx / dy;
@@ -392,16 +1191,42 @@ void Model::AdjustCoordinates(AppData* data) {
 		data->end.x *= GetAspectRatio();
 	}
 
-	const auto min_x = lon2xm(min_lon_);
-	const auto min_y = lat2ym(min_lat_);
+	min_x_ = LonToMeters(min_lon_);
+	min_y_ = LatToMeters(min_lat_);
 	metric_scale_ = std::max(dx, dy);
 
 	for (auto& node : nodes_) {
-		node.x = (lon2xm(node.x) - min_x) / metric_scale_;
-		node.y = (lat2ym(node.y) - min_y) / metric_scale_;
+		ProjectNode(node);
 	}
 }
 
+// Converts a node's lon/lat, stored in x and y while parsing, to the model's cartesian coordinates.
+void Model::ProjectNode(Node& node) const {
+	node.x = (LonToMeters(node.x) - min_x_) / metric_scale_;
+	node.y = (LatToMeters(node.y) - min_y_) / metric_scale_;
+}
+
+// Converts lon/lat coordinates to the model's cartesian coordinates; the inverse of UnprojectNode.
+Model::Node Model::ProjectCoordinates(double lon, double lat) const {
+	Node node;
+	node.x = lon;
+	node.y = lat;
+	ProjectNode(node);
+	return node;
+}
+
+void Model::UnprojectNode(const Node& node, double& lon, double& lat) const {
+	lon = (node.x * metric_scale_ + min_x_) / (DEG_TO_RAD / 2 * EARTH_RADIUS);
+	lat = (atan(exp((node.y * metric_scale_ + min_y_) * 2 / EARTH_RADIUS)) - PI / 4) * 2 / DEG_TO_RAD;
+}
+
+void Model::GetBounds(double& min_lon, double& min_lat, double& max_lon, double& max_lat) const {
+	min_lon = min_lon_;
+	min_lat = min_lat_;
+	max_lon = max_lon_;
+	max_lat = max_lat_;
+}
+
 void Model::InitializePoint(Model::Node& point, Model::Node& other) {
 	point.x = other.x;
 	point.y = other.y;
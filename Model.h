@@ -3,6 +3,10 @@
 #define ROUTE_APP_MODEL_H
 
 #include <pugixml.hpp>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -11,6 +15,8 @@ using namespace pugi;
 
 namespace route_app {
     struct AppData;
+    struct QueryTile;
+    class OSMStream;
 
     class Model {
     public:
@@ -54,12 +60,28 @@ namespace route_app {
             Type type;
         };
 
+        enum class LayerFlags {
+            ROADS = 1, BUILDINGS = 2, LANDUSES = 4, LEISURES = 8, WATERS = 16, RAILWAYS = 32, ALL = 63
+        };
+
+        struct FeatureRef {
+            LayerFlags layer;
+            int index;
+        };
+
+        struct RelationRecord {
+            FeatureRef feature;
+            vector<int> outer;
+            vector<int> inner;
+        };
+
         Model(AppData* data);
         ~Model();
-        double GetMetricScale() { return metric_scale_; }
+        double GetMetricScale() const { return metric_scale_; }
         double GetAspectRatio();
         auto& GetBuildings() { return buildings_; }
         auto& GetRoads() { return roads_; }
+        auto& GetRoads() const { return roads_; }
         auto& GetRailways() { return railways_; }
         auto& GetLanduses() { return landuses_; }
         auto& GetLeisures() { return leisures_; }
@@ -72,18 +94,39 @@ namespace route_app {
         void InitializePoint(Node& point, Node& other);
         Model::Node& GetStartingPoint() { return start_; }
         Model::Node& GetEndingPoint() { return end_; }
+        static int LayersFromString(string_view layers);
+        static Model* Load(const string& filename, unsigned int layers = (unsigned int)LayerFlags::ALL);
+        Node ProjectCoordinates(double lon, double lat) const;
+        void UnprojectNode(const Node& node, double& lon, double& lat) const;
+        void GetBounds(double& min_lon, double& min_lat, double& max_lon, double& max_lat) const;
+        bool ApplyChange(const string& filename);
+        vector<string> DescribeRoadGraph() const;
+        bool MatchesRoadGraph(const Model& other) const;
     private:
         xml_document doc_;
+        // The uncompressed text of a compressed document, which doc_ is parsed from in place.
+        vector<char> doc_buffer_;
         bool model_created_;
         double min_lat_ = 0.;
         double max_lat_ = 0.;
         double min_lon_ = 0.;
         double max_lon_ = 0.;
         double metric_scale_ = 1.f;
+        double min_x_ = 0.;
+        double min_y_ = 0.;
         double aspect_ratio_;
+        unsigned int layers_ = (unsigned int)LayerFlags::ALL;
+        int skipped_ways_ = 0;
+        bool bounds_parsed_ = false;
         unordered_map<string, int> node_id_to_number_;
         unordered_map<string, int> way_id_to_number_;
         unordered_map<int, vector<int>> node_number_to_road_numbers_;
+        unordered_map<string, RelationRecord> relation_id_to_record_;
+        unordered_map<int, vector<FeatureRef>> way_number_to_features_;
+        // Multipolygons of parsed relations whose rings are not stitched yet.
+        vector<FeatureRef> unstitched_features_;
+        vector<int> free_ring_ways_;
+        bool feature_index_built_ = false;
         vector<Building> buildings_;
         vector<Railway> railways_;
         vector<Landuse> landuses_;
@@ -96,16 +139,40 @@ namespace route_app {
         Node start_;
         Node end_;
 
+        Model(const QueryTile& tile, unsigned int layers);
         xml_parse_result OpenDocument(AppData* data);
+        bool LoadTiles(const vector<QueryTile>& tiles);
+        void Merge(const Model& tile);
         void ParseData(AppData* data);
-        void ParseBounds();
+        bool ParseStream(OSMStream* stream);
+        void ParseElement(const xml_node& element, int& index);
+        void CompleteParsing(chrono::steady_clock::time_point start_time);
+        void ParseBounds(const xml_node& bounds);
         void ParseNode(const xml_node& node, int& index);
         void ParseAttributes(const xml_node& node, int index);
         void ParseRelations(const xpath_node& relation, int& index);
+        bool IsWaySelected(const xml_node& way) const;
+        bool IsLayerSelected(int layer) const { return (layers_ & layer) != 0; }
+        void CompactNodes();
         void PrintData();
         void CreateRoadGraph();
         void AdjustCoordinates(AppData* data);
+        void ProjectNode(Node& node) const;
+        void BuildFeatureIndex();
+        void ApplyNodeChange(string_view action, const xml_node& element);
+        void ApplyWayChange(string_view action, const xml_node& element);
+        void ApplyRelationChange(string_view action, const xml_node& element);
+        void ParseWayFeatures(const xml_node& way, int index);
+        void RemoveWayFeatures(int index);
+        void RemoveRelation(const string& id);
+        void RebuildRelations(int way_number);
+        void RebuildRelation(const RelationRecord& record);
+        void ReleaseRingWays(const RelationRecord& record, const Multipolygon& mp);
+        Multipolygon* GetMultipolygon(FeatureRef feature);
+        void AddRoadToGraph(int road_number);
+        void RemoveRoadFromGraph(int road_number);
         void BuildRings(Multipolygon& mp);
+        void BuildPendingRings();
         void Release();
     };
 
@@ -0,0 +1,173 @@
+#include "OSMStream.h"
+#include "Helper.h"
+
+using namespace route_app;
+
+OSMStream::OSMStream() {
+}
+
+// Waits until the consumer has taken the buffered data below the high-water mark. Returns false when the
+// stream was cancelled, so that the producer can stop; data after the end of the document is dropped.
+bool OSMStream::Write(const char* data, size_t size) {
+	{
+		unique_lock<mutex> lock(mutex_);
+		space_available_.wait(lock, [&] { return incoming_.size() < HIGH_WATER_MARK || cancelled_ || drained_; });
+		if (cancelled_) {
+			return false;
+		}
+		bytes_received_ += size;
+		if (drained_) {
+			return true;
+		}
+		incoming_.append(data, size);
+	}
+	data_available_.notify_one();
+	return true;
+}
+
+void OSMStream::Close(bool success) {
+	{
+		lock_guard<mutex> lock(mutex_);
+		closed_ = true;
+		failed_ = !success;
+	}
+	data_available_.notify_one();
+}
+
+// Called by the consumer when it stops reading before the end of the stream; a waiting or later Write
+// returns false.
+void OSMStream::Cancel() {
+	{
+		lock_guard<mutex> lock(mutex_);
+		cancelled_ = true;
+		incoming_.clear();
+	}
+	space_available_.notify_all();
+}
+
+bool OSMStream::NextBatch(string& batch) {
+	while (true) {
+		Scan();
+		if (boundary_ > content_start_) {
+			batch.assign("<osm>");
+			batch.append(buffer_, content_start_, boundary_ - content_start_);
+			batch.append("</osm>");
+			buffer_.erase(0, boundary_);
+			scan_position_ -= boundary_;
+			content_start_ = 0;
+			boundary_ = 0;
+			return true;
+		}
+		unique_lock<mutex> lock(mutex_);
+		if (root_closed_) {
+			drained_ = true;
+			incoming_.clear();
+			lock.unlock();
+			space_available_.notify_all();
+			return false;
+		}
+		data_available_.wait(lock, [&] { return !incoming_.empty() || closed_; });
+		if (failed_ || incoming_.empty()) {
+			return false;
+		}
+		buffer_ += incoming_;
+		incoming_.clear();
+		lock.unlock();
+		space_available_.notify_all();
+	}
+}
+
+// Finds the '>' that ends the markup starting at tag_start, skipping quoted attribute values.
+// Returns false when the markup is not complete yet.
+bool OSMStream::FindTagEnd(size_t tag_start, size_t& tag_end) const {
+	if (buffer_[tag_start + 1] == '!' && buffer_.size() - tag_start < 4) {
+		return false;
+	}
+	if (buffer_.compare(tag_start, 4, "<!--") == 0) {
+		tag_end = buffer_.find("-->", tag_start + 4);
+		if (tag_end == string::npos) {
+			return false;
+		}
+		tag_end += 2;
+		return true;
+	}
+	char quote = 0;
+	for (size_t i = tag_start + 1; i < buffer_.size(); i++) {
+		char c = buffer_[i];
+		if (quote != 0) {
+			if (c == quote) {
+				quote = 0;
+			}
+		}
+		else if (c == '"' || c == '\'') {
+			quote = c;
+		}
+		else if (c == '>') {
+			tag_end = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Advances over the buffered markup, tracking the element depth and remembering the end of the last
+// complete top-level element in boundary_.
+void OSMStream::Scan() {
+	while (!root_closed_) {
+		size_t tag_start = buffer_.find('<', scan_position_);
+		if (tag_start == string::npos) {
+			scan_position_ = buffer_.size();
+			return;
+		}
+		if (tag_start + 1 >= buffer_.size()) {
+			scan_position_ = tag_start;
+			return;
+		}
+		size_t tag_end;
+		if (!FindTagEnd(tag_start, tag_end)) {
+			scan_position_ = tag_start;
+			return;
+		}
+		scan_position_ = tag_end + 1;
+
+		char kind = buffer_[tag_start + 1];
+		if (kind == '?' || kind == '!') {
+			continue;
+		}
+		if (kind == '/') {
+			depth_--;
+			if (depth_ == 1) {
+				boundary_ = scan_position_;
+			}
+			else if (depth_ == 0) {
+				root_closed_ = true;
+			}
+		}
+		else if (buffer_[tag_end - 1] == '/') {
+			if (depth_ == 1) {
+				boundary_ = scan_position_;
+			}
+		}
+		else {
+			if (!root_opened_) {
+				root_opened_ = true;
+				content_start_ = scan_position_;
+				boundary_ = scan_position_;
+			}
+			depth_++;
+		}
+	}
+}
+
+bool OSMStream::IsComplete() {
+	lock_guard<mutex> lock(mutex_);
+	return root_closed_ && !failed_;
+}
+
+size_t OSMStream::GetBytesReceived() {
+	lock_guard<mutex> lock(mutex_);
+	return bytes_received_;
+}
+
+OSMStream::~OSMStream() {
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef ROUTE_APP_OSM_STREAM_H
+#define ROUTE_APP_OSM_STREAM_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+namespace route_app {
+
+	// A byte stream of OSM XML that is written by a producer (e.g. the libcurl write callback) and read by
+	// a consumer thread in batches of complete top-level elements (<bounds>, <node>, <way>, <relation>).
+	// Every batch is wrapped in its own <osm> root, so it can be parsed as an independent document.
+	// The producer blocks while more than HIGH_WATER_MARK bytes wait for the consumer, so that a fast
+	// producer cannot buffer the whole document; a consumer that gives up cancels the stream.
+	class OSMStream {
+	private:
+		static const size_t HIGH_WATER_MARK = 8 << 20;
+
+		mutex mutex_;
+		condition_variable data_available_;
+		condition_variable space_available_;
+		string incoming_;
+		bool closed_ = false;
+		bool failed_ = false;
+		bool cancelled_ = false;
+		bool drained_ = false;
+		size_t bytes_received_ = 0;
+
+		string buffer_;
+		size_t scan_position_ = 0;
+		size_t content_start_ = 0;
+		size_t boundary_ = 0;
+		int depth_ = 0;
+		bool root_opened_ = false;
+		bool root_closed_ = false;
+
+		void Scan();
+		bool FindTagEnd(size_t tag_start, size_t& tag_end) const;
+	public:
+		OSMStream();
+		~OSMStream();
+		bool Write(const char* data, size_t size);
+		void Close(bool success);
+		void Cancel();
+		bool NextBatch(string& batch);
+		bool IsComplete();
+		size_t GetBytesReceived();
+	};
+}
+
+#endif
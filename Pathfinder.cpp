@@ -1,4 +1,6 @@
 #include "Helper.h"
+#include "Logger.h"
+#include "Metrics.h"
 #include "Pathfinder.h"
 
 using namespace route_app;
@@ -21,7 +23,8 @@ void Pathfinder::Initialize(AppData* data) {
 }
 
 void Pathfinder::CreateRoute() {
-	PrintDebugMessage(APPLICATION_NAME, "Pathfinder", "Creating route...", true);
+	LOG_DEBUG("Pathfinder", "Creating route...");
+	METRICS_SCOPE("pathfinder.create_route");
 
 	start_node_index_ = FindNearestRoadNode(model_->GetStartingPoint());
 	end_node_index_ = FindNearestRoadNode(model_->GetEndingPoint());
@@ -54,14 +57,19 @@ void Pathfinder::CreateRoute() {
 }
 
 bool Pathfinder::StartAStarSearch() {
+	SearchCounters counters;
 	open_list_[nodes_[start_node_index_]] = start_node_index_;
+	counters.pushes++;
 	while (!open_list_.empty()) {
 		int current = open_list_.begin()->second;
 		open_list_.erase(open_list_.begin());
+		counters.pops++;
+		counters.expanded++;
 		double f = 0.0f;
 		double h = 0.0f;
 		double distance = 0.0f;
 		vector<int> new_neighbour_nodes = DiscoverNeighbourNodes(current);
+		counters.neighbours += new_neighbour_nodes.size();
 		for (auto it = new_neighbour_nodes.begin(); it != new_neighbour_nodes.end(); it++) {
 			distance = EuclideanDistance(nodes_[*it], nodes_[current]);
 			node_distance_from_start_[*it] = node_distance_from_start_[current] + distance;
@@ -72,6 +80,7 @@ bool Pathfinder::StartAStarSearch() {
 				nodes_[*it].f = f;
 				nodes_[*it].h = h;
 				nodes_[*it].parent = current;
+				METRICS_SEARCH("pathfinder", counters);
 				return true;
 			}
 
@@ -95,10 +104,12 @@ bool Pathfinder::StartAStarSearch() {
 				open_list_.erase(nodes_[*it]);
 			}
 			open_list_[nodes_[*it]] = *it;
+			counters.pushes++;
 		}
 		new_neighbour_nodes.clear();
 		closed_list_.insert(current);
 	}
+	METRICS_SEARCH("pathfinder", counters);
 	return false;
 }
 
@@ -0,0 +1,145 @@
+#include <cmath>
+#include <cstring>
+#include "Helper.h"
+#include "Logger.h"
+#include "QueryLog.h"
+
+using namespace route_app;
+
+const char QueryLog::MAGIC[4] = { 'R', 'A', 'Q', 'L' };
+
+static void Put(char*& out, const void* value, size_t size) {
+	memcpy(out, value, size);
+	out += size;
+}
+
+static void Get(const char*& in, void* value, size_t size) {
+	memcpy(value, in, size);
+	in += size;
+}
+
+static int32_t ToFixed(double degrees) {
+	return (int32_t)llround(degrees * 1e7);
+}
+
+QueryLog::QueryLog(const string& filename) : filename_(filename) {
+	Initialize();
+}
+
+QueryLog::~QueryLog() {
+	Release();
+}
+
+void QueryLog::Initialize() {
+	file_.open(filename_, ios::binary | ios::trunc);
+	if (!file_) {
+		LOG_ERROR("QueryLog", "Error opening file '{}'.", filename_);
+		return;
+	}
+	char header[HEADER_SIZE];
+	char* out = header;
+	uint16_t version = VERSION;
+	uint16_t record_size = RECORD_SIZE;
+	int64_t start_time = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+	Put(out, MAGIC, sizeof(MAGIC));
+	Put(out, &version, sizeof(version));
+	Put(out, &record_size, sizeof(record_size));
+	Put(out, &start_time, sizeof(start_time));
+	file_.write(header, HEADER_SIZE);
+	buffer_.reserve(BUFFER_SIZE);
+	start_time_ = chrono::steady_clock::now();
+	LOG_INFO("QueryLog", "Recording route queries to '{}'.", filename_);
+}
+
+// Thread-safe. The time of the entry is set to the time since the log was opened; it is taken under the
+// lock, so that the times of the records never decrease.
+void QueryLog::Record(Entry entry) {
+	lock_guard<mutex> lock(mutex_);
+	if (!file_.is_open()) {
+		return;
+	}
+	entry.time_ms = (uint32_t)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time_).count();
+	size_t offset = buffer_.size();
+	buffer_.resize(offset + RECORD_SIZE);
+	Encode(entry, buffer_.data() + offset);
+	count_++;
+	if (buffer_.size() + RECORD_SIZE > BUFFER_SIZE) {
+		WriteBuffer();
+	}
+}
+
+void QueryLog::WriteBuffer() {
+	if (file_.is_open() && !buffer_.empty()) {
+		file_.write(buffer_.data(), buffer_.size());
+	}
+	buffer_.clear();
+}
+
+void QueryLog::Encode(const Entry& entry, char* record) {
+	int32_t coordinates[4] = { ToFixed(entry.from_lon), ToFixed(entry.from_lat), ToFixed(entry.to_lon), ToFixed(entry.to_lat) };
+	uint8_t found = entry.found ? 1 : 0;
+	Put(record, &entry.time_ms, sizeof(entry.time_ms));
+	Put(record, coordinates, sizeof(coordinates));
+	Put(record, &entry.from_node, sizeof(entry.from_node));
+	Put(record, &entry.to_node, sizeof(entry.to_node));
+	Put(record, &entry.profile, sizeof(entry.profile));
+	Put(record, &found, sizeof(found));
+	Put(record, &entry.cost, sizeof(entry.cost));
+	Put(record, &entry.latency_us, sizeof(entry.latency_us));
+}
+
+void QueryLog::Decode(const char* record, Entry& entry) {
+	int32_t coordinates[4];
+	uint8_t found;
+	Get(record, &entry.time_ms, sizeof(entry.time_ms));
+	Get(record, coordinates, sizeof(coordinates));
+	Get(record, &entry.from_node, sizeof(entry.from_node));
+	Get(record, &entry.to_node, sizeof(entry.to_node));
+	Get(record, &entry.profile, sizeof(entry.profile));
+	Get(record, &found, sizeof(found));
+	Get(record, &entry.cost, sizeof(entry.cost));
+	Get(record, &entry.latency_us, sizeof(entry.latency_us));
+	entry.from_lon = coordinates[0] / 1e7;
+	entry.from_lat = coordinates[1] / 1e7;
+	entry.to_lon = coordinates[2] / 1e7;
+	entry.to_lat = coordinates[3] / 1e7;
+	entry.found = found != 0;
+}
+
+bool QueryLog::Read(const string& filename, vector<Entry>& entries) {
+	ifstream file(filename, ios::binary);
+	if (!file) {
+		LOG_ERROR("QueryLog", "Error opening file '{}'.", filename);
+		return false;
+	}
+	char header[HEADER_SIZE];
+	const char* in = header;
+	char magic[sizeof(MAGIC)];
+	uint16_t version, record_size;
+	if (!file.read(header, HEADER_SIZE)) {
+		LOG_ERROR("QueryLog", "Error: '{}' is not a query log.", filename);
+		return false;
+	}
+	Get(in, magic, sizeof(magic));
+	Get(in, &version, sizeof(version));
+	Get(in, &record_size, sizeof(record_size));
+	if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION || record_size != RECORD_SIZE) {
+		LOG_ERROR("QueryLog", "Error: '{}' is not a query log of version {}.", filename, (int)VERSION);
+		return false;
+	}
+	char record[RECORD_SIZE];
+	while (file.read(record, RECORD_SIZE)) {
+		entries.emplace_back();
+		Decode(record, entries.back());
+	}
+	return true;
+}
+
+void QueryLog::Release() {
+	lock_guard<mutex> lock(mutex_);
+	if (file_.is_open()) {
+		WriteBuffer();
+		file_.close();
+		LOG_INFO("QueryLog", "{} route queries recorded to '{}'.", count_, filename_);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef ROUTE_APP_QUERY_LOG_H
+#define ROUTE_APP_QUERY_LOG_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace route_app {
+
+	// A compact binary log of route queries, for replaying production traffic offline (see QueryReplay.cpp).
+	// The file starts with a 16 byte header (magic "RAQL", format version, record size and the Unix time the
+	// log was started) followed by fixed-size little-endian records. Coordinates are stored as integers of
+	// 1e-7 degrees, the precision of OSM data. Records are buffered and written in blocks, so that the
+	// server's workers only hold the lock for a copy.
+	class QueryLog {
+	public:
+		// RoadGraph only routes by shortest distance; the field keeps the format open for other profiles.
+		static const uint8_t DISTANCE_PROFILE = 0;
+
+		struct Entry {
+			uint32_t time_ms = 0;
+			double from_lon = 0.;
+			double from_lat = 0.;
+			double to_lon = 0.;
+			double to_lat = 0.;
+			int32_t from_node = -1;
+			int32_t to_node = -1;
+			uint8_t profile = DISTANCE_PROFILE;
+			bool found = false;
+			double cost = 0.;
+			uint32_t latency_us = 0;
+		};
+
+		explicit QueryLog(const string& filename);
+		~QueryLog();
+		bool IsOpen() const { return file_.is_open(); }
+		void Record(Entry entry);
+		long long GetCount() const { return count_; }
+		static bool Read(const string& filename, vector<Entry>& entries);
+	private:
+		static const char MAGIC[4];
+		static const uint16_t VERSION = 1;
+		static const size_t HEADER_SIZE = 16;
+		static const size_t RECORD_SIZE = 42;
+		static const size_t BUFFER_SIZE = 64 * 1024;
+
+		ofstream file_;
+		string filename_;
+		mutex mutex_;
+		vector<char> buffer_;
+		long long count_ = 0;
+		chrono::steady_clock::time_point start_time_;
+
+		void Initialize();
+		void Release();
+		void WriteBuffer();
+		static void Encode(const Entry& entry, char* record);
+		static void Decode(const char* record, Entry& entry);
+	};
+}
+
+#endif
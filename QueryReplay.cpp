@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ArgumentParser.h"
+#include "Helper.h"
+#include "Logger.h"
+#include "Model.h"
+#include "QueryLog.h"
+#include "RoadGraph.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace route_app;
+
+// Replays a query log recorded by the route server (-serve ... -query_log) against a map, to measure a
+// change on real traffic. The queries run on several threads, either as fast as possible, at a fixed
+// rate or at the pace they were recorded at. The tool reports the throughput and latency percentiles,
+// and any query whose snapped nodes or route cost differ from the recorded answer. With a rate, the
+// latency of a query counts from the time it was due, so that a replay that falls behind shows it.
+//
+// usage: QueryReplay -f map.osm -log queries.bin [-threads 4] [-rate 0|queries per second|recorded]
+
+struct Options {
+    string filename;
+    string log_filename;
+    size_t threads = 1;
+    string rate = "0";
+};
+
+struct Replayed {
+    int from_node = -1;
+    int to_node = -1;
+    bool found = false;
+    double cost = 0.;
+    double latency_ms = 0.;
+};
+
+static const double COST_TOLERANCE = 1e-6;
+static const size_t MAX_REPORTED_DIFFERENCES = 10;
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    bool parsed = ArgumentParser::ParseOptionPairs(argc, argv, [&options](const string& name, const string& value) {
+        if (name == "-f") options.filename = value;
+        else if (name == "-log") options.log_filename = value;
+        else if (name == "-threads") options.threads = (size_t)max(1, stoi(value));
+        else if (name == "-rate") options.rate = value;
+        else return false;
+        return true;
+    });
+    return parsed && !options.filename.empty() && !options.log_filename.empty();
+}
+
+// The time after the start of the replay at which every query is due; empty to run them back to back.
+// Recorded times count from the earliest query, as the records of older logs are not always in order.
+static bool Schedule(const string& rate, const vector<QueryLog::Entry>& entries, vector<chrono::microseconds>& due) {
+    if (rate == "recorded") {
+        long long first_ms = min_element(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.time_ms < b.time_ms; })->time_ms;
+        for (auto& entry : entries) {
+            due.push_back(chrono::milliseconds((long long)entry.time_ms - first_ms));
+        }
+        return true;
+    }
+    double queries_per_second;
+    try {
+        queries_per_second = stod(rate);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    for (size_t i = 0; queries_per_second > 0. && i < entries.size(); i++) {
+        due.push_back(chrono::microseconds((long long)(i * 1e6 / queries_per_second)));
+    }
+    return queries_per_second >= 0.;
+}
+
+static void Replay(const Model& model, const RoadGraph& graph, const vector<QueryLog::Entry>& entries, const vector<chrono::microseconds>& due,
+    size_t thread_count, vector<Replayed>& replayed) {
+    atomic<size_t> next{ 0 };
+    auto start_time = chrono::steady_clock::now();
+    ThreadPool pool(thread_count);
+    for (size_t t = 0; t < pool.GetThreadCount(); t++) {
+        pool.Submit([&]() {
+            for (size_t i = next++; i < entries.size(); i = next++) {
+                auto& entry = entries[i];
+                auto& result = replayed[i];
+                auto query_start = chrono::steady_clock::now();
+                if (!due.empty()) {
+                    query_start = start_time + due[i];
+                    this_thread::sleep_until(query_start);
+                }
+                RoadGraph::Route route;
+                result.from_node = graph.NearestNode(model.ProjectCoordinates(entry.from_lon, entry.from_lat));
+                result.to_node = graph.NearestNode(model.ProjectCoordinates(entry.to_lon, entry.to_lat));
+                result.found = graph.FindRoute(result.from_node, result.to_node, route);
+                result.cost = route.distance;
+                result.latency_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - query_start).count();
+            }
+        });
+    }
+}
+
+static double Percentile(vector<double>& samples, double percentile) {
+    sort(samples.begin(), samples.end());
+    return samples.empty() ? 0. : samples[min(samples.size() - 1, (size_t)(percentile / 100. * samples.size()))];
+}
+
+static bool SameAnswer(const QueryLog::Entry& entry, const Replayed& result) {
+    if (entry.found != result.found) {
+        return false;
+    }
+    return !entry.found || fabs(entry.cost - result.cost) <= COST_TOLERANCE * max(1., fabs(entry.cost));
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        cout << "usage: QueryReplay -f map.osm -log queries.bin [-threads 4] [-rate 0|queries per second|recorded]" << endl;
+        return EXIT_FAILURE;
+    }
+    vector<QueryLog::Entry> entries;
+    if (!QueryLog::Read(options.log_filename, entries)) {
+        return EXIT_FAILURE;
+    }
+    size_t skipped = entries.size();
+    entries.erase(remove_if(entries.begin(), entries.end(), [](auto& entry) { return entry.profile != QueryLog::DISTANCE_PROFILE; }), entries.end());
+    skipped -= entries.size();
+    vector<chrono::microseconds> due;
+    if (entries.empty() || !Schedule(options.rate, entries, due)) {
+        cout << "Error: The log has no queries to replay or the rate '" << options.rate << "' is invalid." << endl;
+        return EXIT_FAILURE;
+    }
+    Model* model = Model::Load(options.filename);
+    if (model == NULL) {
+        cout << "Error: The map '" << options.filename << "' could not be loaded." << endl;
+        return EXIT_FAILURE;
+    }
+    RoadGraph graph(*model);
+
+    vector<Replayed> replayed(entries.size());
+    auto start_time = chrono::steady_clock::now();
+    Replay(*model, graph, entries, due, options.threads, replayed);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    Logger::Flush();
+
+    vector<double> latencies, recorded_latencies;
+    size_t snapped_differently = 0, different_answers = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        latencies.push_back(replayed[i].latency_ms);
+        recorded_latencies.push_back(entries[i].latency_us / 1000.);
+        if (replayed[i].from_node != entries[i].from_node || replayed[i].to_node != entries[i].to_node) {
+            snapped_differently++;
+        }
+        if (!SameAnswer(entries[i], replayed[i]) && different_answers++ < MAX_REPORTED_DIFFERENCES) {
+            cout << fixed << setprecision(7) << "Query " << i << " (" << entries[i].from_lon << "," << entries[i].from_lat << " to "
+                << entries[i].to_lon << "," << entries[i].to_lat << ") " << setprecision(3)
+                << "recorded " << (entries[i].found ? to_string(entries[i].cost) + " m" : "no route") << ", replayed "
+                << (replayed[i].found ? to_string(replayed[i].cost) + " m" : "no route") << endl;
+        }
+    }
+
+    cout << endl << fixed << setprecision(3);
+    cout << entries.size() << " queries replayed on " << options.threads << " threads in " << seconds << " s: "
+        << entries.size() / max(seconds, 1e-9) << " queries/s." << endl;
+    if (skipped > 0) {
+        cout << skipped << " queries of other profiles were skipped." << endl;
+    }
+    cout << "Latency (ms)   p50 " << Percentile(latencies, 50.) << "  p90 " << Percentile(latencies, 90.) << "  p99 "
+        << Percentile(latencies, 99.) << "  max " << Percentile(latencies, 100.) << endl;
+    cout << "Recorded (ms)  p50 " << Percentile(recorded_latencies, 50.) << "  p90 " << Percentile(recorded_latencies, 90.) << "  p99 "
+        << Percentile(recorded_latencies, 99.) << "  max " << Percentile(recorded_latencies, 100.) << endl;
+    cout << snapped_differently << " queries snapped to different nodes, " << different_answers << " route costs differ." << endl;
+    delete model;
+    return different_answers > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
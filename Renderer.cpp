@@ -1,4 +1,9 @@
 #include <io2d.h>
+#include <algorithm>
+#include <chrono>
+#include "Helper.h"
+#include "Logger.h"
+#include "Metrics.h"
 #include "Model.h"
 #include "Renderer.h"
 
@@ -10,75 +15,265 @@ static float RoadMetricWidth(Model::Road::Type type);
 static rgba_color RoadColor(Model::Road::Type type);
 static dashes RoadDashes(Model::Road::Type type);
 static point_2d ToPoint2D(const Model::Node& node) noexcept;
+static float RoadMinPixelsInMeters(Model::Road::Type type);
+static vector<int> SimplifyWay(const vector<int>& way_nodes, const vector<Model::Node>& nodes, double tolerance);
+static double SignedArea(const vector<int>& way_nodes, const vector<Model::Node>& nodes);
 
-Renderer::Renderer(Model *model) {
+// Douglas-Peucker tolerances, in meters, of the levels of detail 1, 2, ...
+static const double LOD_TOLERANCES[] = { 1., 4., 16., 64. };
+
+// Builds the scene of the model unless one is shared from another renderer of the same model.
+Renderer::Renderer(Model *model, shared_ptr<const Scene> scene) {
     model_ = model;
-    draw_route_ = (model_->GetRoads().size() != 0);
+    draw_route_ = (model_->GetRoads().size() != 0 && !model_->GetRoute().nodes.empty());
     BuildRoadReps();
     BuildLanduseBrushes();
+    if (!scene) {
+        auto built = make_shared<Scene>();
+        BuildSpatialIndex(*built);
+        BuildLevelsOfDetail(*built);
+        scene = std::move(built);
+    }
+    scene_ = std::move(scene);
 }
 
 void Renderer::Initialize(output_surface& surface) {
-    scale_ = static_cast<float>(std::max(surface.dimensions().x(), surface.dimensions().y()));
-    pixels_in_meters_ = static_cast<float>(scale_ / model_->GetMetricScale());
-    matrix_ = matrix_2d::create_scale({ scale_, -scale_ }) * matrix_2d::create_translate({ 0.f, static_cast<float>(surface.dimensions().y()) });
+    SetDimensions(surface.dimensions());
+}
+
+void Renderer::SetDimensions(display_point dimensions) {
+    if (paths_.valid && dimensions.x() == dimensions_.x() && dimensions.y() == dimensions_.y()) {
+        return;
+    }
+    dimensions_ = dimensions;
+    scale_ = static_cast<float>(std::max(dimensions.x(), dimensions.y()));
+    if (!center_set_) {
+        center_.x = dimensions.x() / 2. / scale_;
+        center_.y = dimensions.y() / 2. / scale_;
+    }
+    UpdateMatrix();
+}
+
+// Shows the area around center (in model coordinates) magnified by zoom; zoom 1 fits the whole map.
+void Renderer::SetView(const Model::Node& center, float zoom) {
+    center_ = center;
+    center_set_ = true;
+    zoom_ = std::clamp(zoom, 1.f / 16.f, 65536.f);
+    if (paths_.valid) {
+        UpdateMatrix();
+    }
+}
+
+void Renderer::UpdateMatrix() {
+    float scale = scale_ * zoom_;
+    viewport_ = SpatialIndex::Box{};
+    viewport_.Extend(center_.x - dimensions_.x() / 2. / scale, center_.y - dimensions_.y() / 2. / scale);
+    viewport_.Extend(center_.x + dimensions_.x() / 2. / scale, center_.y + dimensions_.y() / 2. / scale);
+    pixels_in_meters_ = static_cast<float>(scale / model_->GetMetricScale());
+    // The most simplified level whose error stays below half a pixel.
+    lod_level_ = 0;
+    while (lod_level_ < (int)scene_->lod_ways.size() - 1 && LOD_TOLERANCES[lod_level_] * pixels_in_meters_ < 0.5) {
+        lod_level_++;
+    }
+    matrix_ = matrix_2d::create_translate({ static_cast<float>(-viewport_.min_x), static_cast<float>(-viewport_.min_y) }) *
+        matrix_2d::create_scale({ scale, -scale }) * matrix_2d::create_translate({ 0.f, static_cast<float>(dimensions_.y()) });
+    BuildPathCache();
+}
+
+// Precomputes the simplified ways of every level of detail.
+void Renderer::BuildLevelsOfDetail(Scene& scene) const {
+    auto start_time = chrono::steady_clock::now();
+    const auto& ways = model_->GetWays();
+    scene.lod_ways.assign(1, {});
+    size_t model_nodes = 0;
+    for (const auto& way : ways) {
+        model_nodes += way.nodes.size();
+    }
+    string node_counts = to_string(model_nodes);
+    for (double tolerance : LOD_TOLERANCES) {
+        auto& level = scene.lod_ways.emplace_back();
+        level.reserve(ways.size());
+        size_t level_nodes = 0;
+        for (const auto& way : ways) {
+            level.emplace_back().nodes = SimplifyWay(way.nodes, model_->GetNodes(), tolerance / model_->GetMetricScale());
+            level_nodes += level.back().nodes.size();
+        }
+        node_counts += ", " + to_string(level_nodes);
+    }
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+    LOG_INFO("Renderer", "Levels of detail with {} way nodes built in {} ms.", node_counts, elapsed.count());
+}
+
+const Model::Way& Renderer::GetWay(int way_number) const {
+    return lod_level_ == 0 ? model_->GetWays()[way_number] : scene_->lod_ways[lod_level_][way_number];
+}
+
+SpatialIndex::Box Renderer::BoxFromWay(const Model::Way& way) const {
+    const auto& nodes = model_->GetNodes();
+    SpatialIndex::Box box;
+    for (int node_number : way.nodes) {
+        box.Extend(nodes[node_number].x, nodes[node_number].y);
+    }
+    return box;
+}
+
+SpatialIndex::Box Renderer::BoxFromMP(const Model::Multipolygon& mp) const {
+    const auto& ways = model_->GetWays();
+    SpatialIndex::Box box;
+    for (int way_number : mp.outer) {
+        box.Extend(BoxFromWay(ways[way_number]));
+    }
+    return box;
+}
+
+void Renderer::BuildSpatialIndex(Scene& scene) const {
+    auto start_time = chrono::steady_clock::now();
+    const auto& ways = model_->GetWays();
+    auto build = [&](SpatialIndex& index, const auto& features, auto box_from_feature) {
+        vector<SpatialIndex::Box> boxes;
+        boxes.reserve(features.size());
+        for (const auto& feature : features) {
+            boxes.emplace_back(box_from_feature(feature));
+        }
+        index.Build(boxes);
+    };
+    auto box_from_mp = [&](const Model::Multipolygon& mp) { return BoxFromMP(mp); };
+    build(scene.landuse_index, model_->GetLanduses(), box_from_mp);
+    build(scene.leisure_index, model_->GetLeisures(), box_from_mp);
+    build(scene.water_index, model_->GetWaters(), box_from_mp);
+    build(scene.building_index, model_->GetBuildings(), box_from_mp);
+    build(scene.railway_index, model_->GetRailways(), [&](const Model::Railway& railway) {
+        return railway.way < 0 ? SpatialIndex::Box{} : BoxFromWay(ways[railway.way]);
+    });
+    build(scene.road_index, model_->GetRoads(), [&](const Model::Road& road) { return BoxFromWay(ways[road.way]); });
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+    LOG_INFO("Renderer", "Spatial index built in {} ms.", elapsed.count());
+}
+
+// Builds the paths of the features that intersect the viewport, which is widened by a margin for the
+// widest strokes.
+void Renderer::BuildPathCache() {
+    METRICS_SCOPE("renderer.build_paths");
+    auto start_time = chrono::steady_clock::now();
+    SpatialIndex::Box area = viewport_;
+    double margin = 10. / (scale_ * zoom_);
+    area.Extend(viewport_.min_x - margin, viewport_.min_y - margin);
+    area.Extend(viewport_.max_x + margin, viewport_.max_y + margin);
+
+    paths_ = PathCache{};
+    size_t visible_features = 0;
+    vector<int> visible;
+    // With batching, all features of a layer that share a style are added to one path, so that a layer
+    // costs one draw call per style; otherwise every feature gets a path of its own.
+    auto build = [&](vector<StyledPath>& paths, auto style_of, auto add_feature) {
+        visible_features += visible.size();
+        if (!batching_enabled_) {
+            paths.reserve(visible.size());
+            for (int i : visible) {
+                auto pb = path_builder{};
+                pb.matrix(matrix_);
+                add_feature(pb, i);
+                paths.push_back(StyledPath{ style_of(i), interpreted_path{ pb } });
+            }
+            return;
+        }
+        map<int, path_builder> builders;
+        for (int i : visible) {
+            auto [it, inserted] = builders.try_emplace(style_of(i));
+            if (inserted) {
+                it->second.matrix(matrix_);
+            }
+            add_feature(it->second, i);
+        }
+        for (auto& [style, pb] : builders) {
+            paths.push_back(StyledPath{ style, interpreted_path{ pb } });
+        }
+    };
+    auto no_style = [](int) { return 0; };
+
+    scene_->landuse_index.Query(area, visible);
+    build(paths_.landuses, [&](int i) { return (int)model_->GetLanduses()[i].type; },
+        [&](path_builder& pb, int i) { AddMPToPath(pb, model_->GetLanduses()[i]); });
+    scene_->leisure_index.Query(area, visible);
+    build(paths_.leisures, no_style, [&](path_builder& pb, int i) { AddMPToPath(pb, model_->GetLeisures()[i]); });
+    scene_->water_index.Query(area, visible);
+    build(paths_.waters, no_style, [&](path_builder& pb, int i) { AddMPToPath(pb, model_->GetWaters()[i]); });
+    scene_->railway_index.Query(area, visible);
+    build(paths_.railways, no_style, [&](path_builder& pb, int i) { AddWayToPath(pb, GetWay(model_->GetRailways()[i].way)); });
+
+    // Minor roads and buildings are hidden when they would be too small to make out.
+    scene_->road_index.Query(area, visible);
+    visible.erase(remove_if(visible.begin(), visible.end(), [&](int i) {
+        auto rep_it = road_reps_.find(model_->GetRoads()[i].type);
+        return rep_it == road_reps_.end() || pixels_in_meters_ < rep_it->second.min_pixels_in_meters;
+        }), visible.end());
+    build(paths_.roads, [&](int i) { return (int)model_->GetRoads()[i].type; },
+        [&](path_builder& pb, int i) { AddWayToPath(pb, GetWay(model_->GetRoads()[i].way)); });
+    if (pixels_in_meters_ >= buildings_min_pixels_in_meters_) {
+        scene_->building_index.Query(area, visible);
+        build(paths_.buildings, no_style, [&](path_builder& pb, int i) { AddMPToPath(pb, model_->GetBuildings()[i]); });
+    }
+    paths_.route = PathFromWay(model_->GetRoute());
+    paths_.valid = true;
+    static_layers_.reset();
+
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+    LOG_DEBUG("Renderer", "Paths of {} visible features at level of detail {} built in {} ms, {} draw calls per frame.", visible_features, lod_level_, elapsed.count(), GetDrawCallCount());
 }
 
-void Renderer::DrawLanduses(output_surface& surface) const {
-    for (auto& landuse : model_->GetLanduses())
-        if (auto br = landuse_brushes_.find(landuse.type); br != landuse_brushes_.end())
-            surface.fill(br->second, PathFromMP(landuse));
+template <class Surface>
+void Renderer::DrawLanduses(Surface& surface) const {
+    for (auto& styled : paths_.landuses)
+        if (auto br = landuse_brushes_.find((Model::Landuse::Type)styled.style); br != landuse_brushes_.end())
+            surface.fill(br->second, styled.path);
 }
 
-void Renderer::DrawLeisure(output_surface& surface) const {
-    for (auto& leisure : model_->GetLeisures()) {
-        auto path = PathFromMP(leisure);
-        surface.fill(leisure_fill_brush_, path);
-        surface.stroke(leisure_outline_brush_, path, std::nullopt, leisure_outline_stroke_props_);
+template <class Surface>
+void Renderer::DrawLeisure(Surface& surface) const {
+    for (auto& styled : paths_.leisures) {
+        surface.fill(leisure_fill_brush_, styled.path);
+        surface.stroke(leisure_outline_brush_, styled.path, std::nullopt, leisure_outline_stroke_props_);
     }
 }
 
-void Renderer::DrawRailways(output_surface& surface) const {
-    auto ways = model_->GetWays().data();
-    for (auto& railways : model_->GetRailways()) {
-        auto way = ways[railways.way];
-        auto path = PathFromWay(way);
-        surface.stroke(railway_stroke_brush_, path, nullopt, stroke_props{ railway_outer_width_ * pixels_in_meters_ });
-        surface.stroke(railway_dash_brush_, path, nullopt, stroke_props{ railway_inner_width_ * pixels_in_meters_ }, railway_dashes_);
+template <class Surface>
+void Renderer::DrawRailways(Surface& surface) const {
+    for (auto& styled : paths_.railways) {
+        surface.stroke(railway_stroke_brush_, styled.path, nullopt, stroke_props{ railway_outer_width_ * pixels_in_meters_ });
+        surface.stroke(railway_dash_brush_, styled.path, nullopt, stroke_props{ railway_inner_width_ * pixels_in_meters_ }, railway_dashes_);
     }
 }
 
-void Renderer::DrawWater(output_surface& surface) const {
-    for (auto& water : model_->GetWaters()) {
-        surface.fill(water_fill_brush_, PathFromMP(water));
+template <class Surface>
+void Renderer::DrawWater(Surface& surface) const {
+    for (auto& styled : paths_.waters) {
+        surface.fill(water_fill_brush_, styled.path);
     }
 }
 
-void Renderer::DrawBuildings(output_surface& surface) const {
-    for (auto& building : model_->GetBuildings()) {
-        auto path = PathFromMP(building);
-        surface.fill(building_fill_brush_, path);
-        surface.stroke(building_outline_brush_, path, std::nullopt, building_outline_stroke_props_);
+template <class Surface>
+void Renderer::DrawBuildings(Surface& surface) const {
+    for (auto& styled : paths_.buildings) {
+        surface.fill(building_fill_brush_, styled.path);
+        surface.stroke(building_outline_brush_, styled.path, std::nullopt, building_outline_stroke_props_);
     }
 }
 
-void Renderer::DrawHighways(output_surface& surface) const {
-    auto ways = model_->GetWays().data();
-    for (auto road : model_->GetRoads()) {
-        if (auto rep_it = road_reps_.find(road.type); rep_it != road_reps_.end()) {
+template <class Surface>
+void Renderer::DrawHighways(Surface& surface) const {
+    for (auto& styled : paths_.roads) {
+        if (auto rep_it = road_reps_.find((Model::Road::Type)styled.style); rep_it != road_reps_.end()) {
             auto& rep = rep_it->second;
-            auto& way = ways[road.way];
             auto width = rep.metric_width > 0.f ? (rep.metric_width * pixels_in_meters_) : 1.f;
             auto sp = stroke_props{ width, line_cap::round };
-            auto path = PathFromWay(way);
-            surface.stroke(rep.brush, path, nullopt, sp, rep.dashes);
+            surface.stroke(rep.brush, styled.path, nullopt, sp, rep.dashes);
         }
     }
 }
 
-void Renderer::DrawRoute(output_surface& surface) const {
-    auto& way = model_->GetRoute();
-    auto path = PathFromWay(way);
+template <class Surface>
+void Renderer::DrawRoute(Surface& surface) const {
+    auto& path = paths_.route;
     DrawCircle(surface, route_stroke_brush_, route_outline_stroke_props_, model_->GetNodes()[model_->GetRoute().nodes[0]], 0.005f);
     DrawCircle(surface, route_stroke_brush_, route_outline_stroke_props_, model_->GetNodes()[model_->GetRoute().nodes[model_->GetRoute().nodes.size() - 1]], 0.005f);
     surface.stroke(route_stroke_brush_, path, nullopt, route_outline_stroke_props_);
@@ -89,47 +284,66 @@ interpreted_path Renderer::PathFromWay(const Model::Way& way) const {
         return {};
     }
 
-    const auto nodes = model_->GetNodes().data();
-
     auto pb = path_builder{};
     pb.matrix(matrix_);
-    pb.new_figure(ToPoint2D(nodes[way.nodes.front()]));
-    for (auto it = ++way.nodes.begin(); it != end(way.nodes); ++it) {
-        pb.line(ToPoint2D(nodes[*it]));
-    }
+    AddWayToPath(pb, way);
     return interpreted_path{ pb };
 }
 
 interpreted_path Renderer::PathFromMP(const Model::Multipolygon& mp) const {
-    const auto nodes = model_->GetNodes().data();
-    const auto ways = model_->GetWays().data();
-
     auto pb = path_builder{};
     pb.matrix(matrix_);
+    AddMPToPath(pb, mp);
+    return interpreted_path{ pb };
+}
 
-    auto create_path = [&](const Model::Way& way) {
-        if (way.nodes.empty()) {
-            return;
-        }
-        pb.new_figure(ToPoint2D(nodes[way.nodes.front()]));
-        for (auto it = ++way.nodes.begin(); it != end(way.nodes); ++it) {
-            pb.line(ToPoint2D(nodes[*it]));
-        }
+// Adds the way to the path as one figure, which is closed for the rings of multipolygons.
+void Renderer::AddWayToPath(path_builder& pb, const Model::Way& way, bool closed) const {
+    if (way.nodes.empty()) {
+        return;
+    }
+    const auto nodes = model_->GetNodes().data();
+    pb.new_figure(ToPoint2D(nodes[way.nodes.front()]));
+    for (auto it = ++way.nodes.begin(); it != end(way.nodes); ++it) {
+        pb.line(ToPoint2D(nodes[*it]));
+    }
+    if (closed) {
         pb.close_figure();
-    };
+    }
+}
+
+// Adds the way to the path as a closed figure whose nodes run in the given direction.
+void Renderer::AddRingToPath(path_builder& pb, const Model::Way& way, bool counter_clockwise) const {
+    if (way.nodes.empty()) {
+        return;
+    }
+    const auto& nodes = model_->GetNodes();
+    if ((SignedArea(way.nodes, nodes) > 0.) == counter_clockwise) {
+        AddWayToPath(pb, way, true);
+        return;
+    }
+    pb.new_figure(ToPoint2D(nodes[way.nodes.back()]));
+    for (auto it = ++way.nodes.rbegin(); it != way.nodes.rend(); ++it) {
+        pb.line(ToPoint2D(nodes[*it]));
+    }
+    pb.close_figure();
+}
 
+// Adds the outer rings of the multipolygon counter-clockwise and the inner rings clockwise as closed
+// figures to the path. With the nonzero winding rule, the inner rings are then holes, while features
+// batched into the same path that lie inside each other, e.g. nested landuses, stay filled.
+void Renderer::AddMPToPath(path_builder& pb, const Model::Multipolygon& mp) const {
     for (auto way_num : mp.outer) {
-        create_path(ways[way_num]);
+        AddRingToPath(pb, GetWay(way_num), true);
     }
 
     for (auto way_num : mp.inner) {
-        create_path(ways[way_num]);
+        AddRingToPath(pb, GetWay(way_num), false);
     }
-
-    return interpreted_path{ pb };
 }
 
-void Renderer::DrawCircle(output_surface& surface, brush br, stroke_props sp, const Model::Node& point, float radius) const {
+template <class Surface>
+void Renderer::DrawCircle(Surface& surface, brush br, stroke_props sp, const Model::Node& point, float radius) const {
     auto pb = path_builder{};
     pb.matrix(matrix_);
     pb.cubic_curve( point_2d(static_cast<float>(point.x - radius), static_cast<float>(point.y)),
@@ -151,7 +365,8 @@ void Renderer::DrawCircle(output_surface& surface, brush br, stroke_props sp, co
     surface.stroke(br, path, nullopt, sp);
 }
 
-void Renderer::DrawCross(output_surface& surface, brush br, stroke_props sp, const Model::Node& point, float size) const {
+template <class Surface>
+void Renderer::DrawCross(Surface& surface, brush br, stroke_props sp, const Model::Node& point, float size) const {
     auto pb = path_builder{};
     pb.matrix(matrix_);
     pb.new_figure(point_2d(static_cast<float>(point.x - size), static_cast<float>(point.y + size)));
@@ -164,6 +379,22 @@ void Renderer::DrawCross(output_surface& surface, brush br, stroke_props sp, con
 }
 
 void Renderer::Display(output_surface& surface) {
+    METRICS_SCOPE("renderer.frame");
+    if (raster_cache_enabled_) {
+        if (!static_layers_) {
+            RasterizeStaticLayers();
+        }
+        surface.paint(*static_layers_);
+    }
+    else {
+        DrawStaticLayers(surface);
+    }
+    DrawOverlay(surface);
+}
+
+// The base map, from the background up to the buildings; it only changes with the matrix.
+template <class Surface>
+void Renderer::DrawStaticLayers(Surface& surface) const {
     surface.paint(background_fill_brush_);
     DrawLanduses(surface);
     DrawLeisure(surface);
@@ -171,6 +402,10 @@ void Renderer::Display(output_surface& surface) {
     DrawRailways(surface);
     DrawHighways(surface);
     DrawBuildings(surface);
+}
+
+template <class Surface>
+void Renderer::DrawOverlay(Surface& surface) const {
     if (draw_route_) {
         DrawRoute(surface);
     }
@@ -178,6 +413,98 @@ void Renderer::Display(output_surface& surface) {
     DrawCross(surface, test_brush_, route_outline_stroke_props_, model_->GetEndingPoint(), 0.01f);
 }
 
+// With the raster cache, the static layers are drawn once into an image whose brush is painted under
+// the route in every frame, until the matrix changes.
+void Renderer::SetRasterCache(bool enabled) {
+    raster_cache_enabled_ = enabled;
+    static_layers_.reset();
+}
+
+// Batching merges the geometry of each layer and style into a single path; it is on by default.
+void Renderer::SetBatching(bool enabled) {
+    batching_enabled_ = enabled;
+    if (paths_.valid) {
+        BuildPathCache();
+    }
+}
+
+// The number of fill and stroke calls that draw a frame from the current paths.
+size_t Renderer::GetDrawCallCount() const {
+    size_t overlay = (draw_route_ ? 3 : 0) + 2;
+    return 1 + paths_.landuses.size() + 2 * paths_.leisures.size() + paths_.waters.size() + 2 * paths_.railways.size() +
+        paths_.roads.size() + 2 * paths_.buildings.size() + overlay;
+}
+
+// Draws frames of the given size offscreen and returns the average time of a frame in milliseconds.
+double Renderer::MeasureFrameTime(int width, int height, int frames) {
+    SetDimensions(display_point{ width, height });
+    image_surface image{ format::argb32, width, height };
+    auto start_time = chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        DrawStaticLayers(image);
+        DrawOverlay(image);
+        image.flush();
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count() / std::max(1, frames);
+}
+
+// Rebuilds only the path of the route, after the model's route has been replaced; the cached paths and
+// static layers of the map stay valid.
+void Renderer::UpdateRoute() {
+    draw_route_ = !model_->GetRoute().nodes.empty();
+    paths_.route = PathFromWay(model_->GetRoute());
+}
+
+// Renders the map and the route offscreen and saves them as a PNG image, without opening a window.
+// With the raster cache, images of the same size share one rasterization of the static layers.
+bool Renderer::RenderToFile(const string& filename, int width, int height) {
+    METRICS_SCOPE("renderer.image");
+    SetDimensions(display_point{ width, height });
+    image_surface image{ format::argb32, width, height };
+    if (raster_cache_enabled_) {
+        if (!static_layers_) {
+            RasterizeStaticLayers();
+        }
+        image.paint(*static_layers_);
+    }
+    else {
+        DrawStaticLayers(image);
+    }
+    DrawOverlay(image);
+    try {
+        image.save(filename, image_file_format::png);
+    }
+    catch (const exception& e) {
+        LOG_ERROR("Renderer", "Error saving image '{}': {}", filename, e.what());
+        return false;
+    }
+    return true;
+}
+
+// Draws the static layers of the area around center into a map tile, without the route and its markers.
+// Returns false, and leaves the image untouched, when no feature intersects the tile.
+bool Renderer::RenderTile(image_surface& image, const Model::Node& center, float zoom) {
+    METRICS_SCOPE("renderer.tile");
+    SetDimensions(display_point{ image.width(), image.height() });
+    SetView(center, zoom);
+    if (paths_.landuses.empty() && paths_.leisures.empty() && paths_.waters.empty() && paths_.railways.empty() &&
+        paths_.roads.empty() && paths_.buildings.empty()) {
+        return false;
+    }
+    DrawStaticLayers(image);
+    return true;
+}
+
+void Renderer::RasterizeStaticLayers() {
+    METRICS_SCOPE("renderer.rasterize_static_layers");
+    auto start_time = chrono::steady_clock::now();
+    image_surface image{ format::argb32, dimensions_.x(), dimensions_.y() };
+    DrawStaticLayers(image);
+    static_layers_.emplace(std::move(image));
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+    LOG_INFO("Renderer", "Static layers rasterized in {} ms.", elapsed.count());
+}
+
 void Renderer::Resize(output_surface& surface) {
     surface.dimensions(surface.display_dimensions());
     Initialize(surface);
@@ -200,6 +527,7 @@ void Renderer::BuildRoadReps() {
         rep.brush = brush{ RoadColor(type) };
         rep.metric_width = RoadMetricWidth(type);
         rep.dashes = RoadDashes(type);
+        rep.min_pixels_in_meters = RoadMinPixelsInMeters(type);
     }
 }
 
@@ -253,6 +581,116 @@ static dashes RoadDashes(Model::Road::Type type) {
     }    
 }
 
+// The smallest zoom, in pixels per meter, at which roads of a type are drawn.
+static float RoadMinPixelsInMeters(Model::Road::Type type) {
+    switch (type) {
+    case Model::Road::Service:      return 0.15f;
+    case Model::Road::Footway:      return 0.25f;
+    case Model::Road::Cycleway:     return 0.25f;
+    default:                        return 0.f;
+    }
+}
+
+static double DistanceToSegment(const Model::Node& point, const Model::Node& start, const Model::Node& end) {
+    double dx = end.x - start.x;
+    double dy = end.y - start.y;
+    double length = dx * dx + dy * dy;
+    double t = length == 0. ? 0. : std::clamp(((point.x - start.x) * dx + (point.y - start.y) * dy) / length, 0., 1.);
+    return hypot(point.x - start.x - t * dx, point.y - start.y - t * dy);
+}
+
+// Douglas-Peucker simplification of a way. A closed way is split at its node farthest from the first
+// one, so that both halves have distinct endpoints. Closed ways that collapse below a triangle are
+// dropped, because they would be smaller than the tolerance.
+static vector<int> SimplifyWay(const vector<int>& way_nodes, const vector<Model::Node>& nodes, double tolerance) {
+    if (way_nodes.size() < 3) {
+        return way_nodes;
+    }
+    vector<char> keep(way_nodes.size(), 0);
+    vector<pair<size_t, size_t>> segments;
+    size_t last = way_nodes.size() - 1;
+    bool closed = way_nodes.front() == way_nodes.back();
+    if (closed) {
+        size_t farthest = 1;
+        double maximum_distance = -1.;
+        for (size_t i = 1; i < last; i++) {
+            double distance = hypot(nodes[way_nodes[i]].x - nodes[way_nodes[0]].x, nodes[way_nodes[i]].y - nodes[way_nodes[0]].y);
+            if (distance > maximum_distance) {
+                maximum_distance = distance;
+                farthest = i;
+            }
+        }
+        keep[farthest] = 1;
+        segments.emplace_back(0, farthest);
+        segments.emplace_back(farthest, last);
+    }
+    else {
+        segments.emplace_back(0, last);
+    }
+    keep[0] = keep[last] = 1;
+
+    while (!segments.empty()) {
+        auto [first, end] = segments.back();
+        segments.pop_back();
+        size_t farthest = first;
+        double maximum_distance = 0.;
+        for (size_t i = first + 1; i < end; i++) {
+            double distance = DistanceToSegment(nodes[way_nodes[i]], nodes[way_nodes[first]], nodes[way_nodes[end]]);
+            if (distance > maximum_distance) {
+                maximum_distance = distance;
+                farthest = i;
+            }
+        }
+        if (maximum_distance > tolerance) {
+            keep[farthest] = 1;
+            segments.emplace_back(first, farthest);
+            segments.emplace_back(farthest, end);
+        }
+    }
+
+    vector<int> simplified;
+    for (size_t i = 0; i < way_nodes.size(); i++) {
+        if (keep[i]) {
+            simplified.emplace_back(way_nodes[i]);
+        }
+    }
+    if (closed && simplified.size() < 4) {
+        simplified.clear();
+    }
+    return simplified;
+}
+
+// Twice the area enclosed by the way, positive when its nodes run counter-clockwise; the way is treated
+// as closed.
+static double SignedArea(const vector<int>& way_nodes, const vector<Model::Node>& nodes) {
+    double area = 0.;
+    for (size_t i = 0; i < way_nodes.size(); i++) {
+        const auto& a = nodes[way_nodes[i]];
+        const auto& b = nodes[way_nodes[(i + 1) % way_nodes.size()]];
+        area += a.x * b.y - b.x * a.y;
+    }
+    return area;
+}
+
 static point_2d ToPoint2D(const Model::Node& node) noexcept {
     return point_2d(static_cast<float>(node.x), static_cast<float>(node.y));
 }
+
+template void Renderer::DrawBuildings(output_surface& surface) const;
+template void Renderer::DrawBuildings(image_surface& surface) const;
+template void Renderer::DrawHighways(output_surface& surface) const;
+template void Renderer::DrawHighways(image_surface& surface) const;
+template void Renderer::DrawLanduses(output_surface& surface) const;
+template void Renderer::DrawLanduses(image_surface& surface) const;
+template void Renderer::DrawLeisure(output_surface& surface) const;
+template void Renderer::DrawLeisure(image_surface& surface) const;
+template void Renderer::DrawRailways(output_surface& surface) const;
+template void Renderer::DrawRailways(image_surface& surface) const;
+template void Renderer::DrawWater(output_surface& surface) const;
+template void Renderer::DrawWater(image_surface& surface) const;
+template void Renderer::DrawRoute(output_surface& surface) const;
+template void Renderer::DrawRoute(image_surface& surface) const;
+template void Renderer::DrawCircle(output_surface& surface, brush br, stroke_props sp, const Model::Node& point, float radius) const;
+template void Renderer::DrawCircle(image_surface& surface, brush br, stroke_props sp, const Model::Node& point, float radius) const;
+template void Renderer::DrawCross(output_surface& surface, brush br, stroke_props sp, const Model::Node& point, float size) const;
+template void Renderer::DrawCross(image_surface& surface, brush br, stroke_props sp, const Model::Node& point, float size) const;
@@ -3,28 +3,89 @@
 #define ROUTE_APP_RENDERER_H
 
 #include "Model.h"
+#include "SpatialIndex.h"
 #include <io2d.h>
+#include <memory>
 
 using namespace std::experimental::io2d;
 
 namespace route_app {
 
     class Renderer {
+        public:
+            // The spatial indexes and the levels of detail of the model's features. They do not change once
+            // built, so renderers of the same model, e.g. the workers of the TileRenderer, can share them.
+            struct Scene {
+                SpatialIndex landuse_index;
+                SpatialIndex leisure_index;
+                SpatialIndex water_index;
+                SpatialIndex railway_index;
+                SpatialIndex road_index;
+                SpatialIndex building_index;
+                // Simplified copies of all ways, one list per level of detail; level 0 are the model's ways.
+                vector<vector<Model::Way>> lod_ways;
+            };
         private:
 
             struct RoadRep {
                 brush brush{ rgba_color::black };
                 dashes dashes{};
                 float metric_width = 1.f;
+                float min_pixels_in_meters = 0.f;
+            };
+
+            // A path and the style it is drawn with: the road or landuse type, or 0 in single style layers.
+            struct StyledPath {
+                int style;
+                interpreted_path path;
+            };
+
+            // Paths of the features in the viewport, transformed by matrix_. They are rebuilt only when the
+            // matrix changes, i.e. when the surface is resized or the view is panned or zoomed.
+            struct PathCache {
+                vector<StyledPath> landuses;
+                vector<StyledPath> leisures;
+                vector<StyledPath> waters;
+                vector<StyledPath> railways;
+                vector<StyledPath> roads;
+                vector<StyledPath> buildings;
+                interpreted_path route;
+                bool valid = false;
             };
 
             void Release();
+            void BuildPathCache();
+            void BuildSpatialIndex(Scene& scene) const;
+            void UpdateMatrix();
+            void SetDimensions(display_point dimensions);
+            SpatialIndex::Box BoxFromWay(const Model::Way& way) const;
+            SpatialIndex::Box BoxFromMP(const Model::Multipolygon& mp) const;
+            void BuildLevelsOfDetail(Scene& scene) const;
+            const Model::Way& GetWay(int way_number) const;
+            void AddWayToPath(path_builder& pb, const Model::Way& way, bool closed = false) const;
+            void AddRingToPath(path_builder& pb, const Model::Way& way, bool counter_clockwise) const;
+            void AddMPToPath(path_builder& pb, const Model::Multipolygon& mp) const;
+            void RasterizeStaticLayers();
+            template <class Surface> void DrawStaticLayers(Surface& surface) const;
+            template <class Surface> void DrawOverlay(Surface& surface) const;
             brush mainColor { rgba_color::green };
             Model *model_;
             bool draw_route_;
             float scale_ = 1.f;
             float pixels_in_meters_ = 1.f;
             matrix_2d matrix_;
+            display_point dimensions_;
+            PathCache paths_;
+            shared_ptr<const Scene> scene_;
+            SpatialIndex::Box viewport_;
+            Model::Node center_;
+            bool center_set_ = false;
+            float zoom_ = 1.f;
+            int lod_level_ = 0;
+            float buildings_min_pixels_in_meters_ = 0.2f;
+            bool raster_cache_enabled_ = false;
+            bool batching_enabled_ = true;
+            optional<brush> static_layers_;
             brush building_fill_brush_                  { rgba_color{208, 197, 190} };
             brush background_fill_brush_                { rgba_color{238, 235, 227} };
             brush building_outline_brush_               { rgba_color{181, 167, 154} };
@@ -53,20 +114,31 @@ namespace route_app {
             void Initialize(output_surface& surface);
             void Display(output_surface& surface);
             void Resize(output_surface& surface);
-            void DrawBuildings(output_surface& surface) const;
-            void DrawHighways(output_surface& surface) const;
-            void DrawLanduses(output_surface& surface) const;
-            void DrawLeisure(output_surface& surface) const;
-            void DrawRailways(output_surface& surface) const;
-            void DrawWater(output_surface& surface) const;
-            void DrawRoute(output_surface& surface) const;
-            void DrawCircle(output_surface& surface, brush br, stroke_props sp, const Model::Node& point, float radius) const;
-            void DrawCross(output_surface& surface, brush br, stroke_props sp, const Model::Node& point, float size) const;
+            void SetRasterCache(bool enabled);
+            void SetBatching(bool enabled);
+            size_t GetDrawCallCount() const;
+            double MeasureFrameTime(int width, int height, int frames);
+            void UpdateRoute();
+            bool RenderToFile(const string& filename, int width, int height);
+            bool RenderTile(image_surface& image, const Model::Node& center, float zoom);
+            void SetView(const Model::Node& center, float zoom);
+            // The draw methods work on both output_surface and image_surface; they are instantiated for
+            // these two in Renderer.cpp.
+            template <class Surface> void DrawBuildings(Surface& surface) const;
+            template <class Surface> void DrawHighways(Surface& surface) const;
+            template <class Surface> void DrawLanduses(Surface& surface) const;
+            template <class Surface> void DrawLeisure(Surface& surface) const;
+            template <class Surface> void DrawRailways(Surface& surface) const;
+            template <class Surface> void DrawWater(Surface& surface) const;
+            template <class Surface> void DrawRoute(Surface& surface) const;
+            template <class Surface> void DrawCircle(Surface& surface, brush br, stroke_props sp, const Model::Node& point, float radius) const;
+            template <class Surface> void DrawCross(Surface& surface, brush br, stroke_props sp, const Model::Node& point, float size) const;
             interpreted_path PathFromMP(const Model::Multipolygon& mp) const;
             interpreted_path PathFromWay(const Model::Way& way) const;
             void BuildRoadReps();
             void BuildLanduseBrushes();
-            Renderer(Model *model);
+            shared_ptr<const Scene> GetScene() const { return scene_; }
+            Renderer(Model *model, shared_ptr<const Scene> scene = nullptr);
             ~Renderer();
     };
 }
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include "RoadGraph.h"
+#include "Helper.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+using namespace route_app;
+
+typedef pair<double, int> QueueEntry;
+typedef priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> MinQueue;
+
+static const double UNREACHABLE = numeric_limits<double>::infinity();
+
+RoadGraph::RoadGraph(const Model& model) : nodes_(model.GetNodes()) {
+	metric_scale_ = model.GetMetricScale();
+	Initialize(model);
+}
+
+RoadGraph::~RoadGraph() {
+}
+
+// Numbers the nodes that lie on roads as vertices and stores every road segment as two directed edges.
+void RoadGraph::Initialize(const Model& model) {
+	auto start_time = chrono::steady_clock::now();
+	const auto& ways = model.GetWays();
+	node_to_vertex_.assign(nodes_.size(), -1);
+	vector<int> degrees;
+	for (const auto& road : model.GetRoads()) {
+		if (road.type == Model::Road::Invalid) {
+			continue;
+		}
+		const auto& way_nodes = ways[road.way].nodes;
+		for (size_t i = 0; i < way_nodes.size(); i++) {
+			int& vertex = node_to_vertex_[way_nodes[i]];
+			if (vertex == -1) {
+				vertex = (int)vertex_to_node_.size();
+				vertex_to_node_.emplace_back(way_nodes[i]);
+				degrees.emplace_back(0);
+			}
+			degrees[vertex] += (i > 0) + (i + 1 < way_nodes.size());
+		}
+	}
+
+	offsets_.assign(vertex_to_node_.size() + 1, 0);
+	for (size_t i = 0; i < degrees.size(); i++) {
+		offsets_[i + 1] = offsets_[i] + degrees[i];
+	}
+	targets_.resize(offsets_.back());
+	weights_.resize(offsets_.back());
+	vector<int> next(offsets_.begin(), offsets_.end() - 1);
+	auto add_edge = [&](int vertex, int other) {
+		targets_[next[vertex]] = other;
+		weights_[next[vertex]++] = Distance(vertex, other);
+	};
+	for (const auto& road : model.GetRoads()) {
+		if (road.type == Model::Road::Invalid) {
+			continue;
+		}
+		const auto& way_nodes = ways[road.way].nodes;
+		for (size_t i = 1; i < way_nodes.size(); i++) {
+			int vertex = node_to_vertex_[way_nodes[i - 1]];
+			int other = node_to_vertex_[way_nodes[i]];
+			add_edge(vertex, other);
+			add_edge(other, vertex);
+		}
+	}
+	IndexVertices();
+
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+	LOG_INFO("RoadGraph", "Road graph with {} vertices and {} edges built in {} ms.", GetVertexCount(), GetEdgeCount(), elapsed.count());
+}
+
+double RoadGraph::Distance(int vertex, int other) const {
+	const auto& node = nodes_[vertex_to_node_[vertex]];
+	const auto& other_node = nodes_[vertex_to_node_[other]];
+	return sqrt(pow(node.x - other_node.x, 2) + pow(node.y - other_node.y, 2)) * metric_scale_;
+}
+
+// Puts every vertex into a grid index for NearestNode, which starts its search with about the area that
+// holds one vertex on average.
+void RoadGraph::IndexVertices() {
+	vector<SpatialIndex::Box> boxes(vertex_to_node_.size());
+	for (size_t vertex = 0; vertex < boxes.size(); vertex++) {
+		boxes[vertex].Extend(nodes_[vertex_to_node_[vertex]].x, nodes_[vertex_to_node_[vertex]].y);
+	}
+	vertex_index_.Build(boxes);
+	const auto& extent = vertex_index_.GetExtent();
+	double area = extent.IsEmpty() ? 0. : (extent.max_x - extent.min_x) * (extent.max_y - extent.min_y);
+	search_radius_ = std::max(1e-9, sqrt(area / std::max<size_t>(1, boxes.size())));
+}
+
+// Returns the model node number of the road node closest to the point, or -1 for an empty graph. The
+// vertices in a square around the point are searched, and the square grows until it holds a vertex that
+// is no farther than its half width; of vertices at the same distance, the lowest numbered one is taken.
+int RoadGraph::NearestNode(const Model::Node& point) const {
+	const auto& extent = vertex_index_.GetExtent();
+	if (extent.IsEmpty()) {
+		return -1;
+	}
+	// A point outside the vertices' extent starts with a square that reaches it.
+	double outside_x = std::max({ extent.min_x - point.x, point.x - extent.max_x, 0. });
+	double outside_y = std::max({ extent.min_y - point.y, point.y - extent.max_y, 0. });
+	vector<int> candidates;
+	double radius = std::max(search_radius_, std::max(outside_x, outside_y));
+	while (true) {
+		SpatialIndex::Box area;
+		area.Extend(point.x - radius, point.y - radius);
+		area.Extend(point.x + radius, point.y + radius);
+		// Once the square holds all vertices, they are scanned without the index, which would also sort them.
+		bool covers_extent = area.min_x <= extent.min_x && area.min_y <= extent.min_y && area.max_x >= extent.max_x && area.max_y >= extent.max_y;
+		if (covers_extent) {
+			candidates.resize(vertex_to_node_.size());
+			iota(candidates.begin(), candidates.end(), 0);
+		}
+		else {
+			vertex_index_.Query(area, candidates);
+		}
+		int closest_vertex = -1;
+		double minimum_distance = UNREACHABLE;
+		for (int vertex : candidates) {
+			const auto& node = nodes_[vertex_to_node_[vertex]];
+			double distance = pow(point.x - node.x, 2) + pow(point.y - node.y, 2);
+			if (distance < minimum_distance) {
+				minimum_distance = distance;
+				closest_vertex = vertex;
+			}
+		}
+		if (closest_vertex != -1 && (sqrt(minimum_distance) <= radius || covers_extent)) {
+			return vertex_to_node_[closest_vertex];
+		}
+		radius = closest_vertex != -1 ? sqrt(minimum_distance) : radius * 2.;
+	}
+}
+
+// A* search between two model node numbers; the route's nodes run from the start to the goal. The straight-line distance never overestimates the road
+// distance, so the first time the goal leaves the queue its distance is final.
+bool RoadGraph::FindRoute(int from, int to, Route& route) const {
+	route.nodes.clear();
+	route.distance = 0.;
+	if (from < 0 || to < 0 || from >= (int)node_to_vertex_.size() || to >= (int)node_to_vertex_.size()) {
+		return false;
+	}
+	int source = node_to_vertex_[from];
+	int goal = node_to_vertex_[to];
+	if (source == -1 || goal == -1) {
+		return false;
+	}
+
+	vector<double> distances(vertex_to_node_.size(), UNREACHABLE);
+	vector<int> parents(vertex_to_node_.size(), -1);
+	MinQueue open_list;
+	SearchCounters counters;
+	distances[source] = 0.;
+	open_list.emplace(Distance(source, goal), source);
+	counters.pushes++;
+	while (!open_list.empty()) {
+		auto [f, current] = open_list.top();
+		open_list.pop();
+		counters.pops++;
+		if (current == goal) {
+			break;
+		}
+		if (f > distances[current] + Distance(current, goal)) {
+			continue;
+		}
+		counters.expanded++;
+		counters.neighbours += offsets_[current + 1] - offsets_[current];
+		for (int edge = offsets_[current]; edge < offsets_[current + 1]; edge++) {
+			int neighbour = targets_[edge];
+			double distance = distances[current] + weights_[edge];
+			if (distance < distances[neighbour]) {
+				distances[neighbour] = distance;
+				parents[neighbour] = current;
+				open_list.emplace(distance + Distance(neighbour, goal), neighbour);
+				counters.pushes++;
+			}
+		}
+	}
+	METRICS_SEARCH("road_graph.route", counters);
+	if (distances[goal] == UNREACHABLE) {
+		return false;
+	}
+
+	for (int vertex = goal; vertex != -1; vertex = parents[vertex]) {
+		route.nodes.emplace_back(vertex_to_node_[vertex]);
+	}
+	reverse(route.nodes.begin(), route.nodes.end());
+	route.distance = distances[goal];
+	return true;
+}
+
+// Dijkstra search from one model node to many; stops as soon as all targets are settled. Unreachable
+// targets get an infinite distance. The distance and target arrays are kept per thread and only the
+// entries a search touched are reset, so that the many searches of a distance matrix do not each pay
+// for clearing the whole graph.
+vector<double> RoadGraph::FindDistances(int from, const vector<int>& to) const {
+	vector<double> result(to.size(), UNREACHABLE);
+	if (from < 0 || from >= (int)node_to_vertex_.size() || node_to_vertex_[from] == -1) {
+		return result;
+	}
+
+	thread_local vector<double> distances;
+	thread_local vector<char> is_target;
+	thread_local vector<int> touched;
+	if (distances.size() != vertex_to_node_.size()) {
+		distances.assign(vertex_to_node_.size(), UNREACHABLE);
+		is_target.assign(vertex_to_node_.size(), 0);
+	}
+	size_t remaining = 0;
+	for (int node_number : to) {
+		if (node_number >= 0 && node_number < (int)node_to_vertex_.size() && node_to_vertex_[node_number] != -1) {
+			char& flag = is_target[node_to_vertex_[node_number]];
+			remaining += flag == 0;
+			flag = 1;
+		}
+	}
+
+	MinQueue open_list;
+	SearchCounters counters;
+	int source = node_to_vertex_[from];
+	distances[source] = 0.;
+	touched.emplace_back(source);
+	open_list.emplace(0., source);
+	counters.pushes++;
+	while (!open_list.empty() && remaining > 0) {
+		auto [distance, current] = open_list.top();
+		open_list.pop();
+		counters.pops++;
+		if (distance > distances[current]) {
+			continue;
+		}
+		counters.expanded++;
+		counters.neighbours += offsets_[current + 1] - offsets_[current];
+		if (is_target[current] == 1) {
+			is_target[current] = 2;
+			remaining--;
+		}
+		for (int edge = offsets_[current]; edge < offsets_[current + 1]; edge++) {
+			int neighbour = targets_[edge];
+			if (distance + weights_[edge] < distances[neighbour]) {
+				if (distances[neighbour] == UNREACHABLE) {
+					touched.emplace_back(neighbour);
+				}
+				distances[neighbour] = distance + weights_[edge];
+				open_list.emplace(distances[neighbour], neighbour);
+				counters.pushes++;
+			}
+		}
+	}
+	METRICS_SEARCH("road_graph.distances", counters);
+
+	for (size_t i = 0; i < to.size(); i++) {
+		if (to[i] >= 0 && to[i] < (int)node_to_vertex_.size() && node_to_vertex_[to[i]] != -1) {
+			result[i] = distances[node_to_vertex_[to[i]]];
+			is_target[node_to_vertex_[to[i]]] = 0;
+		}
+	}
+	for (int vertex : touched) {
+		distances[vertex] = UNREACHABLE;
+	}
+	touched.clear();
+	return result;
+}
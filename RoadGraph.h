@@ -0,0 +1,47 @@
+#pragma once
+#ifndef ROUTE_APP_ROAD_GRAPH_H
+#define ROUTE_APP_ROAD_GRAPH_H
+
+#include <vector>
+#include "Model.h"
+#include "SpatialIndex.h"
+
+using namespace std;
+
+namespace route_app {
+
+	// An immutable adjacency (compressed sparse row) view of a model's road network. All queries keep their
+	// search state on the stack or in thread-local arrays of the calling thread, so one graph can serve many
+	// threads at once.
+	class RoadGraph {
+	public:
+		struct Route {
+			vector<int> nodes;
+			double distance = 0.;
+		};
+
+		explicit RoadGraph(const Model& model);
+		~RoadGraph();
+		int NearestNode(const Model::Node& point) const;
+		bool FindRoute(int from, int to, Route& route) const;
+		vector<double> FindDistances(int from, const vector<int>& to) const;
+		size_t GetVertexCount() const { return vertex_to_node_.size(); }
+		size_t GetEdgeCount() const { return targets_.size(); }
+	private:
+		const vector<Model::Node>& nodes_;
+		double metric_scale_;
+		vector<int> node_to_vertex_;
+		vector<int> vertex_to_node_;
+		vector<int> offsets_;
+		vector<int> targets_;
+		vector<double> weights_;
+		SpatialIndex vertex_index_;
+		double search_radius_ = 0.;
+
+		void Initialize(const Model& model);
+		void IndexVertices();
+		double Distance(int vertex, int other) const;
+	};
+}
+
+#endif
@@ -0,0 +1,513 @@
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include "RouteServer.h"
+#include "Helper.h"
+#include "Logger.h"
+
+#ifdef _WIN32
+#define close_socket closesocket
+#else
+#define close_socket close
+static const route_app::socket_t INVALID_SOCKET = -1;
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace route_app;
+
+static const size_t MAX_REQUEST_SIZE = 8192;
+static const size_t MAX_MATRIX_POINTS = 100;
+static const int RECEIVE_TIMEOUT_MS = 5000;
+
+atomic<bool> RouteServer::stop_requested_{ false };
+atomic<bool> RouteServer::reload_requested_{ false };
+
+static string StatusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    default: return "Internal Server Error";
+    }
+}
+
+static string UrlDecode(const string& text) {
+    string decoded;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size() && isxdigit((unsigned char)text[i + 1]) && isxdigit((unsigned char)text[i + 2])) {
+            decoded += (char)stoi(text.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        }
+        else {
+            decoded += text[i] == '+' ? ' ' : text[i];
+        }
+    }
+    return decoded;
+}
+
+static string JsonEscape(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        if ((unsigned char)c >= 0x20) {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static string FormatNumber(double value, int precision) {
+    if (!isfinite(value)) {
+        return "null";
+    }
+    ostringstream stream;
+    stream << fixed << setprecision(precision) << value;
+    return stream.str();
+}
+
+// Takes ownership of the model. The loader builds the model for a reload and returns NULL on failure;
+// without a loader, reloads are refused.
+RouteServer::RouteServer(Model* model, int port, size_t thread_count, ModelLoader loader) {
+    auto snapshot = make_shared<Snapshot>();
+    snapshot->model = shared_ptr<Model>(model);
+    snapshot->graph = make_unique<RoadGraph>(*model);
+    snapshot->version = 1;
+    snapshot_ = snapshot;
+    loader_ = loader;
+    port_ = port;
+    thread_count_ = thread_count;
+    listen_socket_ = INVALID_SOCKET;
+}
+
+RouteServer::~RouteServer() {
+    Release();
+}
+
+bool RouteServer::Initialize() {
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        LOG_ERROR("RouteServer", "Error: Winsock could not be initialized.");
+        return false;
+    }
+#endif
+    listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_socket_ == INVALID_SOCKET) {
+        LOG_ERROR("RouteServer", "Error: The server socket could not be created.");
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((unsigned short)port_);
+    if (::bind(listen_socket_, (sockaddr*)&address, sizeof(address)) != 0 || listen(listen_socket_, SOMAXCONN) != 0) {
+        LOG_ERROR("RouteServer", "Error: Could not listen on port {}.", port_);
+        return false;
+    }
+
+    pool_ = new ThreadPool(thread_count_);
+    return true;
+}
+
+// Accepts connections until RequestStop is called, e.g. from a SIGINT handler.
+bool RouteServer::Run() {
+    if (!Initialize()) {
+        return false;
+    }
+    LOG_INFO("RouteServer", "Serving on http://127.0.0.1:{} with {} worker threads.", port_, pool_->GetThreadCount());
+
+    while (!stop_requested_) {
+        if (reload_requested_.exchange(false)) {
+            StartReload();
+        }
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(listen_socket_, &read_set);
+        timeval timeout{ 0, 200000 };
+        if (select((int)listen_socket_ + 1, &read_set, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        socket_t client = accept(listen_socket_, NULL, NULL);
+        if (client == INVALID_SOCKET) {
+            continue;
+        }
+        pool_->Submit([this, client]() { HandleConnection(client); });
+    }
+
+    LOG_INFO("RouteServer", "Stopping server...");
+    return true;
+}
+
+void RouteServer::RequestStop() {
+    stop_requested_ = true;
+}
+
+// Can be called from a signal handler (SIGHUP) or the /reload endpoint; the accept loop starts the reload.
+void RouteServer::RequestReload() {
+    reload_requested_ = true;
+}
+
+void RouteServer::StartReload() {
+    if (!loader_) {
+        LOG_ERROR("RouteServer", "Error: The model cannot be reloaded, it was not loaded from a file.");
+        return;
+    }
+    if (reloading_.exchange(true)) {
+        LOG_INFO("RouteServer", "A reload is already in progress.");
+        return;
+    }
+    if (reload_.valid()) {
+        reload_.get();
+    }
+    reload_ = async(launch::async, &RouteServer::Reload, this);
+}
+
+// Builds the next snapshot while the current one keeps serving, then publishes it.
+void RouteServer::Reload() {
+    LOG_INFO("RouteServer", "Reloading the model...");
+    auto start_time = chrono::steady_clock::now();
+    auto current = atomic_load(&snapshot_);
+    auto snapshot = make_shared<Snapshot>();
+    snapshot->model = shared_ptr<Model>(loader_());
+    if (snapshot->model) {
+        snapshot->graph = make_unique<RoadGraph>(*snapshot->model);
+        snapshot->version = current->version + 1;
+        atomic_store(&snapshot_, shared_ptr<const Snapshot>(snapshot));
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+        last_reload_ms_ = elapsed.count();
+        reloads_++;
+        LOG_INFO("RouteServer", "Model version {} published after {} ms; queries in flight finish on version {}.", snapshot->version, elapsed.count(), current->version);
+    }
+    else {
+        LOG_ERROR("RouteServer", "Error: The reload failed, version {} stays in service.", current->version);
+    }
+    reloading_ = false;
+}
+
+void RouteServer::HandleConnection(socket_t client) {
+#ifdef _WIN32
+    DWORD timeout = RECEIVE_TIMEOUT_MS;
+#else
+    timeval timeout{ RECEIVE_TIMEOUT_MS / 1000, 0 };
+#endif
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+    string text;
+    char buffer[1024];
+    while (text.find("\r\n\r\n") == string::npos && text.size() < MAX_REQUEST_SIZE) {
+        int received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        text.append(buffer, received);
+    }
+
+    auto start_time = chrono::steady_clock::now();
+    bool during_reload = reloading_;
+    auto snapshot = atomic_load(&snapshot_);
+    Request request;
+    Response response;
+    if (text.compare(0, 4, "GET ") != 0) {
+        response = Error(405, "Only GET requests are supported.");
+    }
+    else if (!ParseRequest(text, request)) {
+        response = Error(400, "Malformed request.");
+    }
+    else {
+        response = Dispatch(request, *snapshot);
+    }
+    snapshot.reset();
+    (response.status == 200 ? requests_served_ : requests_failed_)++;
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count();
+    latencies_.Record(elapsed);
+    if (during_reload || reloading_) {
+        reload_latencies_.Record(elapsed);
+    }
+
+    string reply = "HTTP/1.1 " + to_string(response.status) + " " + StatusText(response.status) + "\r\n" +
+        "Content-Type: application/json\r\n" +
+        "Content-Length: " + to_string(response.body.size()) + "\r\n" +
+        "Connection: close\r\n\r\n" + response.body;
+    size_t sent = 0;
+    while (sent < reply.size()) {
+        int result = send(client, reply.data() + sent, (int)(reply.size() - sent), MSG_NOSIGNAL);
+        if (result <= 0) {
+            break;
+        }
+        sent += result;
+    }
+    close_socket(client);
+}
+
+bool RouteServer::ParseRequest(const string& text, Request& request) {
+    size_t target_end = text.find(' ', 4);
+    if (target_end == string::npos) {
+        return false;
+    }
+    string target = text.substr(4, target_end - 4);
+    size_t query_start = target.find('?');
+    request.path = target.substr(0, query_start);
+    if (query_start == string::npos) {
+        return true;
+    }
+
+    stringstream query(target.substr(query_start + 1));
+    string parameter;
+    while (getline(query, parameter, '&')) {
+        size_t separator = parameter.find('=');
+        if (separator == string::npos) {
+            return false;
+        }
+        request.parameters[UrlDecode(parameter.substr(0, separator))] = UrlDecode(parameter.substr(separator + 1));
+    }
+    return true;
+}
+
+RouteServer::Response RouteServer::Dispatch(const Request& request, const Snapshot& snapshot) const {
+    if (request.path == "/info") {
+        return HandleInfo(snapshot);
+    }
+    if (request.path == "/stats") {
+        return HandleStats(snapshot);
+    }
+    if (request.path == "/reload") {
+        return HandleReload();
+    }
+    if (request.path == "/nearest") {
+        return HandleNearest(request, snapshot);
+    }
+    if (request.path == "/route") {
+        return HandleRoute(request, snapshot);
+    }
+    if (request.path == "/matrix") {
+        return HandleMatrix(request, snapshot);
+    }
+    return Error(404, "Unknown endpoint '" + request.path + "'.");
+}
+
+RouteServer::Response RouteServer::HandleInfo(const Snapshot& snapshot) const {
+    double min_lon, min_lat, max_lon, max_lat;
+    snapshot.model->GetBounds(min_lon, min_lat, max_lon, max_lat);
+    Response response;
+    response.body = "{\"bounds\":[" + FormatNumber(min_lon, 7) + "," + FormatNumber(min_lat, 7) + "," +
+        FormatNumber(max_lon, 7) + "," + FormatNumber(max_lat, 7) + "],\"vertices\":" +
+        to_string(snapshot.graph->GetVertexCount()) + ",\"edges\":" + to_string(snapshot.graph->GetEdgeCount()) +
+        ",\"version\":" + to_string(snapshot.version) + "}";
+    return response;
+}
+
+RouteServer::Response RouteServer::HandleStats(const Snapshot& snapshot) const {
+    Response response;
+    response.body = "{\"version\":" + to_string(snapshot.version) + ",\"reloading\":" + (reloading_ ? "true" : "false") +
+        ",\"reloads\":" + to_string(reloads_) + ",\"last_reload_ms\":" + to_string(last_reload_ms_) +
+        ",\"latency_ms\":" + FormatLatencies(latencies_) +
+        ",\"latency_during_reload_ms\":" + FormatLatencies(reload_latencies_) + "}";
+    return response;
+}
+
+// GET /reload re-reads the map file; the answer does not wait for the new model.
+RouteServer::Response RouteServer::HandleReload() const {
+    if (!loader_) {
+        return Error(400, "The model was not loaded from a file and cannot be reloaded.");
+    }
+    RequestReload();
+    Response response;
+    response.body = "{\"reloading\":true}";
+    return response;
+}
+
+// GET /nearest?point=lon,lat
+RouteServer::Response RouteServer::HandleNearest(const Request& request, const Snapshot& snapshot) const {
+    Model::Node point;
+    auto it = request.parameters.find("point");
+    if (it == request.parameters.end() || !ReadPoint(it->second, snapshot, point)) {
+        return Error(400, "Expected 'point=lon,lat'.");
+    }
+    int node_number = snapshot.graph->NearestNode(point);
+    if (node_number == -1) {
+        return Error(404, "The model has no roads.");
+    }
+    Response response;
+    response.body = "{\"node\":" + FormatNode(node_number, snapshot) + "}";
+    return response;
+}
+
+// GET /route?from=lon,lat&to=lon,lat
+RouteServer::Response RouteServer::HandleRoute(const Request& request, const Snapshot& snapshot) const {
+    auto start_time = chrono::steady_clock::now();
+    QueryLog::Entry entry;
+    auto from_it = request.parameters.find("from");
+    auto to_it = request.parameters.find("to");
+    if (from_it == request.parameters.end() || to_it == request.parameters.end() ||
+        !ReadCoordinates(from_it->second, entry.from_lon, entry.from_lat) || !ReadCoordinates(to_it->second, entry.to_lon, entry.to_lat)) {
+        return Error(400, "Expected 'from=lon,lat&to=lon,lat'.");
+    }
+
+    RoadGraph::Route route;
+    entry.from_node = snapshot.graph->NearestNode(snapshot.model->ProjectCoordinates(entry.from_lon, entry.from_lat));
+    entry.to_node = snapshot.graph->NearestNode(snapshot.model->ProjectCoordinates(entry.to_lon, entry.to_lat));
+    entry.found = snapshot.graph->FindRoute(entry.from_node, entry.to_node, route);
+    if (query_log_ != NULL) {
+        entry.cost = route.distance;
+        entry.latency_us = (uint32_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start_time).count();
+        query_log_->Record(entry);
+    }
+    if (!entry.found) {
+        return Error(404, "No route was found.");
+    }
+    Response response;
+    response.body = "{\"distance\":" + FormatNumber(route.distance, 1) + ",\"nodes\":[";
+    for (size_t i = 0; i < route.nodes.size(); i++) {
+        response.body += (i > 0 ? "," : "") + FormatNode(route.nodes[i], snapshot);
+    }
+    response.body += "]}";
+    return response;
+}
+
+// GET /matrix?points=lon,lat;lon,lat;... answers the road distances between all pairs of points.
+RouteServer::Response RouteServer::HandleMatrix(const Request& request, const Snapshot& snapshot) const {
+    auto it = request.parameters.find("points");
+    if (it == request.parameters.end()) {
+        return Error(400, "Expected 'points=lon,lat;lon,lat;...'.");
+    }
+    vector<int> node_numbers;
+    stringstream points(it->second);
+    string text;
+    while (getline(points, text, ';')) {
+        Model::Node point;
+        if (!ReadPoint(text, snapshot, point)) {
+            return Error(400, "Malformed point '" + text + "'.");
+        }
+        node_numbers.emplace_back(snapshot.graph->NearestNode(point));
+    }
+    if (node_numbers.empty() || node_numbers.size() > MAX_MATRIX_POINTS) {
+        return Error(400, "Expected between 1 and " + to_string(MAX_MATRIX_POINTS) + " points.");
+    }
+
+    Response response;
+    response.body = "{\"distances\":[";
+    for (size_t i = 0; i < node_numbers.size(); i++) {
+        vector<double> distances = snapshot.graph->FindDistances(node_numbers[i], node_numbers);
+        response.body += i > 0 ? ",[" : "[";
+        for (size_t j = 0; j < distances.size(); j++) {
+            response.body += (j > 0 ? "," : "") + FormatNumber(distances[j], 1);
+        }
+        response.body += "]";
+    }
+    response.body += "]}";
+    return response;
+}
+
+// Reads 'lon,lat'.
+bool RouteServer::ReadCoordinates(const string& text, double& lon, double& lat) {
+    size_t separator = text.find(',');
+    if (separator == string::npos) {
+        return false;
+    }
+    try {
+        size_t lon_end, lat_end;
+        lon = stod(text.substr(0, separator), &lon_end);
+        lat = stod(text.substr(separator + 1), &lat_end);
+        return lon_end == separator && lat_end == text.size() - separator - 1 && fabs(lat) < 90. && fabs(lon) <= 180.;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+// Reads 'lon,lat' and projects it to model coordinates.
+bool RouteServer::ReadPoint(const string& text, const Snapshot& snapshot, Model::Node& point) {
+    double lon, lat;
+    if (!ReadCoordinates(text, lon, lat)) {
+        return false;
+    }
+    point = snapshot.model->ProjectCoordinates(lon, lat);
+    return true;
+}
+
+string RouteServer::FormatNode(int node_number, const Snapshot& snapshot) {
+    double lon, lat;
+    snapshot.model->UnprojectNode(snapshot.model->GetNodes()[node_number], lon, lat);
+    return "[" + FormatNumber(lon, 7) + "," + FormatNumber(lat, 7) + "]";
+}
+
+string RouteServer::FormatLatencies(const LatencyHistogram& histogram) {
+    return "{\"count\":" + to_string(histogram.GetCount()) + ",\"p50\":" + FormatNumber(histogram.Percentile(50), 3) +
+        ",\"p99\":" + FormatNumber(histogram.Percentile(99), 3) + "}";
+}
+
+static const double LATENCY_GROWTH = 1.1;
+static const double MIN_LATENCY_MS = 0.001;
+
+void RouteServer::LatencyHistogram::Record(double milliseconds) {
+    int bucket = milliseconds <= MIN_LATENCY_MS ? 0 : (int)ceil(log(milliseconds / MIN_LATENCY_MS) / log(LATENCY_GROWTH));
+    buckets_[std::min(bucket, (int)buckets_.size() - 1)]++;
+    count_++;
+}
+
+// Returns the upper bound of the bucket that holds the percentile, i.e. at most 10% above the true value.
+double RouteServer::LatencyHistogram::Percentile(double percentile) const {
+    long long count = count_;
+    if (count == 0) {
+        return 0.;
+    }
+    long long rank = std::max(1LL, (long long)ceil(percentile / 100. * count));
+    long long seen = 0;
+    for (size_t bucket = 0; bucket < buckets_.size(); bucket++) {
+        seen += buckets_[bucket];
+        if (seen >= rank) {
+            return MIN_LATENCY_MS * pow(LATENCY_GROWTH, (double)bucket);
+        }
+    }
+    return MIN_LATENCY_MS * pow(LATENCY_GROWTH, (double)buckets_.size() - 1);
+}
+
+RouteServer::Response RouteServer::Error(int status, const string& message) {
+    Response response;
+    response.status = status;
+    response.body = "{\"error\":\"" + JsonEscape(message) + "\"}";
+    return response;
+}
+
+void RouteServer::Release() {
+    if (pool_ != NULL) {
+        delete pool_;
+        pool_ = NULL;
+    }
+    if (reload_.valid()) {
+        reload_.get();
+    }
+    if (listen_socket_ != INVALID_SOCKET) {
+        close_socket(listen_socket_);
+        listen_socket_ = INVALID_SOCKET;
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+    if (requests_served_ + requests_failed_ > 0) {
+        LOG_INFO("RouteServer", "Requests served: {}, failed: {}.", requests_served_, requests_failed_);
+        LOG_INFO("RouteServer", "Latency (ms): {}, during reloads: {}.", FormatLatencies(latencies_), FormatLatencies(reload_latencies_));
+    }
+}
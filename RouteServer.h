@@ -0,0 +1,113 @@
+#pragma once
+#ifndef ROUTE_APP_ROUTE_SERVER_H
+#define ROUTE_APP_ROUTE_SERVER_H
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+#include <array>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Model.h"
+#include "QueryLog.h"
+#include "RoadGraph.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace route_app {
+#ifdef _WIN32
+	typedef SOCKET socket_t;
+#else
+	typedef int socket_t;
+#endif
+
+	// A headless server that answers route, nearest node and distance matrix queries over HTTP on the
+	// loopback interface. The model and its road graph are loaded once; every connection is handled on
+	// a worker of a thread pool, and the answers are small JSON documents.
+	//
+	// The model and graph form an immutable snapshot behind a shared_ptr. A reload builds the next snapshot
+	// on a background thread and publishes it with an atomic store; queries that already hold the previous
+	// snapshot finish on it, and it is freed when the last of them releases it.
+	class RouteServer {
+	public:
+		typedef function<Model*()> ModelLoader;
+	private:
+		struct Snapshot {
+			shared_ptr<Model> model;
+			unique_ptr<RoadGraph> graph;
+			int version;
+		};
+
+		// Latencies in buckets that grow by 10%, so that percentiles can be recorded without locks.
+		class LatencyHistogram {
+		private:
+			array<atomic<long long>, 200> buckets_{};
+			atomic<long long> count_{ 0 };
+		public:
+			void Record(double milliseconds);
+			double Percentile(double percentile) const;
+			long long GetCount() const { return count_; }
+		};
+
+		struct Request {
+			string path;
+			unordered_map<string, string> parameters;
+		};
+
+		struct Response {
+			int status = 200;
+			string body;
+		};
+
+		shared_ptr<const Snapshot> snapshot_;
+		ModelLoader loader_;
+		future<void> reload_;
+		atomic<bool> reloading_{ false };
+		atomic<int> reloads_{ 0 };
+		atomic<long long> last_reload_ms_{ 0 };
+		LatencyHistogram latencies_;
+		LatencyHistogram reload_latencies_;
+		ThreadPool* pool_ = NULL;
+		QueryLog* query_log_ = NULL;
+		int port_;
+		size_t thread_count_;
+		socket_t listen_socket_;
+		atomic<long long> requests_served_{ 0 };
+		atomic<long long> requests_failed_{ 0 };
+		static atomic<bool> stop_requested_;
+		static atomic<bool> reload_requested_;
+
+		bool Initialize();
+		void Release();
+		void HandleConnection(socket_t client);
+		void StartReload();
+		void Reload();
+		Response Dispatch(const Request& request, const Snapshot& snapshot) const;
+		Response HandleInfo(const Snapshot& snapshot) const;
+		Response HandleStats(const Snapshot& snapshot) const;
+		Response HandleReload() const;
+		Response HandleNearest(const Request& request, const Snapshot& snapshot) const;
+		Response HandleRoute(const Request& request, const Snapshot& snapshot) const;
+		Response HandleMatrix(const Request& request, const Snapshot& snapshot) const;
+		static bool ReadCoordinates(const string& text, double& lon, double& lat);
+		static bool ReadPoint(const string& text, const Snapshot& snapshot, Model::Node& point);
+		static string FormatNode(int node_number, const Snapshot& snapshot);
+		static string FormatLatencies(const LatencyHistogram& histogram);
+		static bool ParseRequest(const string& text, Request& request);
+		static Response Error(int status, const string& message);
+	public:
+		RouteServer(Model* model, int port, size_t thread_count, ModelLoader loader);
+		~RouteServer();
+		void SetQueryLog(QueryLog* query_log) { query_log_ = query_log; }
+		bool Run();
+		static void RequestStop();
+		static void RequestReload();
+	};
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cmath>
+#include "SpatialIndex.h"
+
+using namespace route_app;
+
+// Features that would be stored in more cells than this (e.g. large landuse areas) are kept in a
+// separate list that every query checks, so that they do not bloat the grid.
+static const int MAX_CELLS_PER_ITEM = 64;
+
+bool SpatialIndex::Box::Intersects(const Box& other) const {
+	return !IsEmpty() && !other.IsEmpty() && min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y && other.min_y <= max_y;
+}
+
+void SpatialIndex::Box::Extend(double x, double y) {
+	if (IsEmpty()) {
+		min_x = max_x = x;
+		min_y = max_y = y;
+		return;
+	}
+	min_x = std::min(min_x, x);
+	min_y = std::min(min_y, y);
+	max_x = std::max(max_x, x);
+	max_y = std::max(max_y, y);
+}
+
+void SpatialIndex::Box::Extend(const Box& other) {
+	if (!other.IsEmpty()) {
+		Extend(other.min_x, other.min_y);
+		Extend(other.max_x, other.max_y);
+	}
+}
+
+SpatialIndex::SpatialIndex() {
+}
+
+SpatialIndex::~SpatialIndex() {
+}
+
+// Builds a grid of about four features per cell; empty boxes are stored but never returned.
+void SpatialIndex::Build(const vector<Box>& boxes) {
+	boxes_ = boxes;
+	extent_ = Box{};
+	for (const auto& box : boxes_) {
+		extent_.Extend(box);
+	}
+	large_items_.clear();
+	int cells_per_side = std::max(1, std::min(1024, (int)sqrt(boxes_.size() / 4.)));
+	columns_ = cells_per_side;
+	rows_ = cells_per_side;
+	cell_width_ = std::max(1e-12, (extent_.max_x - extent_.min_x) / columns_);
+	cell_height_ = std::max(1e-12, (extent_.max_y - extent_.min_y) / rows_);
+
+	vector<int> counts(columns_ * rows_ + 1, 0);
+	auto for_each_cell = [&](int item, auto action) {
+		int first_column, first_row, last_column, last_row;
+		CellRange(boxes_[item], first_column, first_row, last_column, last_row);
+		for (int row = first_row; row <= last_row; row++) {
+			for (int column = first_column; column <= last_column; column++) {
+				action(row * columns_ + column);
+			}
+		}
+	};
+	auto is_large = [&](int item) {
+		int first_column, first_row, last_column, last_row;
+		CellRange(boxes_[item], first_column, first_row, last_column, last_row);
+		return (last_column - first_column + 1) * (last_row - first_row + 1) > MAX_CELLS_PER_ITEM;
+	};
+
+	for (int item = 0; item < (int)boxes_.size(); item++) {
+		if (boxes_[item].IsEmpty()) {
+			continue;
+		}
+		if (is_large(item)) {
+			large_items_.emplace_back(item);
+			continue;
+		}
+		for_each_cell(item, [&](int cell) { counts[cell + 1]++; });
+	}
+	for (size_t cell = 1; cell < counts.size(); cell++) {
+		counts[cell] += counts[cell - 1];
+	}
+	cell_offsets_ = counts;
+	cell_items_.resize(counts.back());
+	for (int item = 0; item < (int)boxes_.size(); item++) {
+		if (!boxes_[item].IsEmpty() && !is_large(item)) {
+			for_each_cell(item, [&](int cell) { cell_items_[counts[cell]++] = item; });
+		}
+	}
+}
+
+void SpatialIndex::CellRange(const Box& box, int& first_column, int& first_row, int& last_column, int& last_row) const {
+	auto clamp_column = [&](double x) { return std::clamp((int)floor((x - extent_.min_x) / cell_width_), 0, columns_ - 1); };
+	auto clamp_row = [&](double y) { return std::clamp((int)floor((y - extent_.min_y) / cell_height_), 0, rows_ - 1); };
+	first_column = clamp_column(box.min_x);
+	last_column = clamp_column(box.max_x);
+	first_row = clamp_row(box.min_y);
+	last_row = clamp_row(box.max_y);
+}
+
+void SpatialIndex::Query(const Box& area, vector<int>& result) const {
+	result.clear();
+	if (!area.Intersects(extent_)) {
+		return;
+	}
+	int first_column, first_row, last_column, last_row;
+	CellRange(area, first_column, first_row, last_column, last_row);
+	for (int row = first_row; row <= last_row; row++) {
+		for (int column = first_column; column <= last_column; column++) {
+			int cell = row * columns_ + column;
+			for (int i = cell_offsets_[cell]; i < cell_offsets_[cell + 1]; i++) {
+				if (boxes_[cell_items_[i]].Intersects(area)) {
+					result.emplace_back(cell_items_[i]);
+				}
+			}
+		}
+	}
+	for (int item : large_items_) {
+		if (boxes_[item].Intersects(area)) {
+			result.emplace_back(item);
+		}
+	}
+	sort(result.begin(), result.end());
+	result.erase(unique(result.begin(), result.end()), result.end());
+}
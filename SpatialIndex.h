@@ -0,0 +1,48 @@
+#pragma once
+#ifndef ROUTE_APP_SPATIAL_INDEX_H
+#define ROUTE_APP_SPATIAL_INDEX_H
+
+#include <vector>
+
+using namespace std;
+
+namespace route_app {
+
+	// A uniform grid over the bounding boxes of a list of features. A query returns the indices of the
+	// features whose boxes intersect an area, in ascending order, so that callers keep their draw order.
+	// Queries do not modify the index and can run on several threads at once.
+	class SpatialIndex {
+	public:
+		struct Box {
+			double min_x = 1.;
+			double min_y = 1.;
+			double max_x = 0.;
+			double max_y = 0.;
+			bool IsEmpty() const { return min_x > max_x || min_y > max_y; }
+			bool Intersects(const Box& other) const;
+			void Extend(double x, double y);
+			void Extend(const Box& other);
+		};
+
+		SpatialIndex();
+		~SpatialIndex();
+		void Build(const vector<Box>& boxes);
+		void Query(const Box& area, vector<int>& result) const;
+		size_t GetSize() const { return boxes_.size(); }
+		const Box& GetExtent() const { return extent_; }
+	private:
+		Box extent_;
+		int columns_ = 0;
+		int rows_ = 0;
+		double cell_width_ = 1.;
+		double cell_height_ = 1.;
+		vector<Box> boxes_;
+		vector<int> cell_offsets_;
+		vector<int> cell_items_;
+		vector<int> large_items_;
+
+		void CellRange(const Box& box, int& first_column, int& first_row, int& last_column, int& last_row) const;
+	};
+}
+
+#endif
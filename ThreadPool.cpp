@@ -0,0 +1,55 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+using namespace route_app;
+
+ThreadPool::ThreadPool(size_t thread_count) {
+	Initialize(std::max<size_t>(1, thread_count));
+}
+
+void ThreadPool::Initialize(size_t thread_count) {
+	for (size_t i = 0; i < thread_count; i++) {
+		workers_.emplace_back(&ThreadPool::Work, this);
+	}
+}
+
+void ThreadPool::Submit(function<void()> task) {
+	{
+		lock_guard<mutex> lock(mutex_);
+		tasks_.emplace_back(std::move(task));
+	}
+	task_available_.notify_one();
+}
+
+void ThreadPool::Work() {
+	while (true) {
+		function<void()> task;
+		{
+			unique_lock<mutex> lock(mutex_);
+			task_available_.wait(lock, [&] { return stopping_ || !tasks_.empty(); });
+			if (tasks_.empty()) {
+				return;
+			}
+			task = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+		task();
+	}
+}
+
+// Finishes the queued tasks before the workers are joined.
+void ThreadPool::Release() {
+	{
+		lock_guard<mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	task_available_.notify_all();
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+	workers_.clear();
+}
+
+ThreadPool::~ThreadPool() {
+	Release();
+}
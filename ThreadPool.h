@@ -0,0 +1,36 @@
+#pragma once
+#ifndef ROUTE_APP_THREAD_POOL_H
+#define ROUTE_APP_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace route_app {
+
+	// A fixed number of worker threads that run submitted tasks in FIFO order.
+	class ThreadPool {
+	private:
+		vector<thread> workers_;
+		deque<function<void()>> tasks_;
+		mutex mutex_;
+		condition_variable task_available_;
+		bool stopping_ = false;
+
+		void Initialize(size_t thread_count);
+		void Release();
+		void Work();
+	public:
+		explicit ThreadPool(size_t thread_count);
+		~ThreadPool();
+		void Submit(function<void()> task);
+		size_t GetThreadCount() const { return workers_.size(); }
+	};
+}
+
+#endif
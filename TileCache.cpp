@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "Helper.h"
+#include "Logger.h"
+#include "TileCache.h"
+
+using namespace route_app;
+
+static long long Now() {
+	return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+TileCache::TileCache(string directory, size_t max_bytes, long long max_age_seconds) {
+	directory_ = directory;
+	max_bytes_ = max_bytes;
+	max_age_seconds_ = max_age_seconds;
+	Initialize();
+}
+
+TileCache::~TileCache() {
+	Release();
+}
+
+void TileCache::Initialize() {
+	error_code error;
+	filesystem::create_directories(directory_, error);
+	if (error) {
+		LOG_ERROR("TileCache", "Error: Could not create cache directory '{}'.", directory_.string());
+	}
+	LoadStatistics();
+	LoadIndex();
+	LOG_INFO("TileCache", "Using cache directory '{}' ({} entries, {} bytes).", directory_.string(), index_.size(), total_size_);
+}
+
+// The cache key is the server and the bounds, each coordinate rounded to the 7 decimals that OSM stores,
+// so that equivalent queries written differently share an entry.
+string TileCache::NormalizeQuery(const string& url, const string& bounds) {
+	string normalized = url;
+	stringstream coordinates(bounds);
+	string coordinate;
+	char separator = '?';
+	while (getline(coordinates, coordinate, ',')) {
+		char formatted[32];
+		snprintf(formatted, sizeof(formatted), "%.7f", atof(coordinate.c_str()));
+		normalized += separator;
+		normalized += formatted;
+		separator = ',';
+	}
+	return normalized;
+}
+
+// 64 bit FNV-1a, which unlike std::hash is stable across runs and platforms.
+string TileCache::HashKey(const string& query) {
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned char c : query) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", hash);
+	return key;
+}
+
+filesystem::path TileCache::DataPath(const string& key) const {
+	return directory_ / (key + ".osm");
+}
+
+filesystem::path TileCache::MetaPath(const string& key) const {
+	return directory_ / (key + ".meta");
+}
+
+bool TileCache::ReadEntry(const filesystem::path& meta_path, Entry& entry) const {
+	ifstream meta(meta_path);
+	if (!meta) {
+		return false;
+	}
+	entry = Entry{};
+	entry.key = meta_path.stem().string();
+	string line;
+	while (getline(meta, line)) {
+		auto separator = line.find('=');
+		if (separator == string::npos) {
+			continue;
+		}
+		auto name = line.substr(0, separator);
+		auto value = line.substr(separator + 1);
+		if (name == "etag")               entry.etag = value;
+		else if (name == "last_modified") entry.last_modified = value;
+		else if (name == "fetched_at")    entry.fetched_at = atoll(value.c_str());
+		else if (name == "accessed_at")   entry.accessed_at = atoll(value.c_str());
+		else if (name == "size")          entry.size = (size_t)atoll(value.c_str());
+	}
+	error_code error;
+	return filesystem::exists(DataPath(entry.key), error);
+}
+
+void TileCache::WriteEntry(const Entry& entry) const {
+	ofstream meta(MetaPath(entry.key), ios::trunc);
+	meta << "etag=" << entry.etag << "\n";
+	meta << "last_modified=" << entry.last_modified << "\n";
+	meta << "fetched_at=" << entry.fetched_at << "\n";
+	meta << "accessed_at=" << entry.accessed_at << "\n";
+	meta << "size=" << entry.size << "\n";
+}
+
+bool TileCache::Lookup(const string& query, Entry& entry) {
+	return ReadEntry(MetaPath(HashKey(query)), entry);
+}
+
+bool TileCache::IsFresh(const Entry& entry) const {
+	return Now() - entry.fetched_at < max_age_seconds_;
+}
+
+bool TileCache::Load(const Entry& entry, vector<char>& bytes) {
+	ifstream data(DataPath(entry.key), ios::binary);
+	if (!data) {
+		return false;
+	}
+	bytes.assign(istreambuf_iterator<char>(data), istreambuf_iterator<char>());
+	return bytes.size() == entry.size;
+}
+
+void TileCache::Store(const string& query, const vector<char>& bytes, const string& etag, const string& last_modified) {
+	Entry entry;
+	entry.key = HashKey(query);
+	entry.etag = etag;
+	entry.last_modified = last_modified;
+	entry.fetched_at = Now();
+	entry.accessed_at = entry.fetched_at;
+	entry.size = bytes.size();
+	{
+		ofstream data(DataPath(entry.key), ios::binary | ios::trunc);
+		data.write(bytes.data(), bytes.size());
+		if (!data) {
+			LOG_ERROR("TileCache", "Error: Could not write cache entry {}.", entry.key);
+			return;
+		}
+	}
+	WriteEntry(entry);
+	UpdateIndex(entry);
+	Evict();
+}
+
+void TileCache::RecordHit(Entry& entry, bool revalidated) {
+	entry.accessed_at = Now();
+	if (revalidated) {
+		entry.fetched_at = entry.accessed_at;
+		run_statistics_.revalidations++;
+		total_statistics_.revalidations++;
+	}
+	else {
+		run_statistics_.hits++;
+		total_statistics_.hits++;
+	}
+	run_statistics_.bytes_saved += entry.size;
+	total_statistics_.bytes_saved += entry.size;
+	WriteEntry(entry);
+	UpdateIndex(entry);
+}
+
+void TileCache::RecordMiss() {
+	run_statistics_.misses++;
+	total_statistics_.misses++;
+}
+
+// Reads the size and access time of every entry in the cache directory; only done once per run.
+void TileCache::LoadIndex() {
+	error_code error;
+	for (const auto& file : filesystem::directory_iterator(directory_, error)) {
+		Entry entry;
+		if (file.path().extension() == ".meta" && ReadEntry(file.path(), entry)) {
+			UpdateIndex(entry);
+		}
+	}
+}
+
+void TileCache::UpdateIndex(const Entry& entry) {
+	if (auto it = index_.find(entry.key); it != index_.end()) {
+		total_size_ -= it->second.size;
+		access_order_.erase({ it->second.accessed_at, entry.key });
+	}
+	index_[entry.key] = entry;
+	access_order_.emplace(entry.accessed_at, entry.key);
+	total_size_ += entry.size;
+}
+
+// Removes the least recently used entries until the cached data fits in max_bytes_.
+void TileCache::Evict() {
+	int evicted = 0;
+	error_code error;
+	while (total_size_ > max_bytes_ && !access_order_.empty()) {
+		string key = access_order_.begin()->second;
+		access_order_.erase(access_order_.begin());
+		filesystem::remove(DataPath(key), error);
+		filesystem::remove(MetaPath(key), error);
+		total_size_ -= index_[key].size;
+		index_.erase(key);
+		evicted++;
+	}
+	if (evicted > 0) {
+		LOG_INFO("TileCache", "Evicted {} entries.", evicted);
+	}
+}
+
+void TileCache::LoadStatistics() {
+	ifstream statistics(directory_ / "statistics");
+	statistics >> total_statistics_.hits >> total_statistics_.revalidations >> total_statistics_.misses >> total_statistics_.bytes_saved;
+	if (!statistics) {
+		total_statistics_ = Statistics{};
+	}
+}
+
+void TileCache::SaveStatistics() const {
+	ofstream statistics(directory_ / "statistics", ios::trunc);
+	statistics << total_statistics_.hits << " " << total_statistics_.revalidations << " " << total_statistics_.misses << " " << total_statistics_.bytes_saved << "\n";
+}
+
+void TileCache::PrintStatistics() const {
+	auto hit_rate = [](const Statistics& statistics) {
+		auto lookups = statistics.hits + statistics.revalidations + statistics.misses;
+		return lookups == 0 ? 0.0 : 100.0 * (statistics.hits + statistics.revalidations) / lookups;
+	};
+	LOG_INFO("TileCache", "This run: {} hits, {} revalidated, {} misses, hit rate {}%, {} bytes saved.", run_statistics_.hits, run_statistics_.revalidations, run_statistics_.misses, hit_rate(run_statistics_), run_statistics_.bytes_saved);
+	LOG_INFO("TileCache", "All runs: hit rate {}%, {} bytes saved.", hit_rate(total_statistics_), total_statistics_.bytes_saved);
+}
+
+void TileCache::Release() {
+	SaveStatistics();
+}
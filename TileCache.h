@@ -0,0 +1,72 @@
+#pragma once
+#ifndef ROUTE_APP_TILE_CACHE_H
+#define ROUTE_APP_TILE_CACHE_H
+
+#include <filesystem>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace route_app {
+
+	// A local, size bounded cache of downloaded map data. Entries are addressed by a hash of the normalized
+	// query and stored as '<hash>.osm' with a '<hash>.meta' file that holds the HTTP validators (ETag and
+	// Last-Modified) and the fetch and access times. The least recently used entries are evicted first; the
+	// sizes and access times of all entries are read once and then kept up to date in memory.
+	class TileCache {
+	public:
+		struct Entry {
+			string key;
+			string etag;
+			string last_modified;
+			long long fetched_at = 0;
+			long long accessed_at = 0;
+			size_t size = 0;
+		};
+
+		struct Statistics {
+			long long hits = 0;
+			long long revalidations = 0;
+			long long misses = 0;
+			long long bytes_saved = 0;
+		};
+
+		TileCache(string directory, size_t max_bytes, long long max_age_seconds);
+		~TileCache();
+		static string NormalizeQuery(const string& url, const string& bounds);
+		bool Lookup(const string& query, Entry& entry);
+		bool IsFresh(const Entry& entry) const;
+		bool Load(const Entry& entry, vector<char>& bytes);
+		void Store(const string& query, const vector<char>& bytes, const string& etag, const string& last_modified);
+		void RecordHit(Entry& entry, bool revalidated);
+		void RecordMiss();
+		void PrintStatistics() const;
+	private:
+		filesystem::path directory_;
+		size_t max_bytes_;
+		long long max_age_seconds_;
+		Statistics run_statistics_;
+		Statistics total_statistics_;
+		unordered_map<string, Entry> index_;
+		set<pair<long long, string>> access_order_;
+		size_t total_size_ = 0;
+
+		void Initialize();
+		void Release();
+		static string HashKey(const string& query);
+		filesystem::path DataPath(const string& key) const;
+		filesystem::path MetaPath(const string& key) const;
+		bool ReadEntry(const filesystem::path& meta_path, Entry& entry) const;
+		void WriteEntry(const Entry& entry) const;
+		void LoadIndex();
+		void UpdateIndex(const Entry& entry);
+		void Evict();
+		void LoadStatistics();
+		void SaveStatistics() const;
+	};
+}
+
+#endif
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cmath>
+#include "Logger.h"
+#include "Metrics.h"
+#include "TileDownloader.h"
+
+using namespace route_app;
+
+static size_t tile_write_callback(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    size_t realsize = size * nmemb;
+    vector<char>* buffer = (vector<char>*)userp;
+    buffer->insert(buffer->end(), (char*)contents, (char*)contents + realsize);
+    return realsize;
+}
+
+static string FormatCoordinate(double value) {
+    return to_string(round(value * 1e7) / 1e7);
+}
+
+TileDownloader::TileDownloader(string url, string api, string query_prefix, int parallelism, int max_retries, int backoff_ms) {
+    query_ = url + api + query_prefix;
+    parallelism_ = (size_t)std::max(1, parallelism);
+    max_retries_ = std::max(0, max_retries);
+    backoff_ms_ = std::max(0, backoff_ms);
+    Initialize();
+}
+
+TileDownloader::~TileDownloader() {
+    Release();
+}
+
+void TileDownloader::Initialize() {
+    multi_handle_ = curl_multi_init();
+    curl_multi_setopt(multi_handle_, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)parallelism_);
+    LOG_DEBUG("TileDownloader", "Tile downloader initialized with {} parallel transfers.", parallelism_);
+}
+
+vector<string> TileDownloader::SplitBounds(double min_lon, double min_lat, double max_lon, double max_lat, double tile_size) {
+    vector<string> bounds;
+    int columns = std::max(1, (int)ceil((max_lon - min_lon) / tile_size - 1e-9));
+    int rows = std::max(1, (int)ceil((max_lat - min_lat) / tile_size - 1e-9));
+    double width = (max_lon - min_lon) / columns;
+    double height = (max_lat - min_lat) / rows;
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            bounds.emplace_back(FormatCoordinate(min_lon + column * width) + "," +
+                FormatCoordinate(min_lat + row * height) + "," +
+                FormatCoordinate(column == columns - 1 ? max_lon : min_lon + (column + 1) * width) + "," +
+                FormatCoordinate(row == rows - 1 ? max_lat : min_lat + (row + 1) * height));
+        }
+    }
+    return bounds;
+}
+
+CURL* TileDownloader::StartTransfer(const Transfer& transfer, const vector<Request>& requests, vector<HTTPResponse>& responses) {
+    const auto& request = requests[transfer.tile];
+    string query = query_ + request.bounds;
+    auto& response = responses[transfer.tile];
+    response = HTTPResponse{};
+
+    Transfer* started = new Transfer(transfer);
+    if (!request.etag.empty()) {
+        started->headers = curl_slist_append(started->headers, ("If-None-Match: " + request.etag).c_str());
+    }
+    if (!request.last_modified.empty()) {
+        started->headers = curl_slist_append(started->headers, ("If-Modified-Since: " + request.last_modified).c_str());
+    }
+
+    CURL* curl_handle = curl_easy_init();
+    curl_easy_setopt(curl_handle, CURLOPT_URL, query.c_str());
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, tile_write_callback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&response.body);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HTTPHandler::HeaderCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void*)&response);
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, started->headers);
+    curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, (void*)started);
+    curl_multi_add_handle(multi_handle_, curl_handle);
+    return curl_handle;
+}
+
+void TileDownloader::FinishTransfer(CURL* curl_handle) {
+    Transfer* transfer = NULL;
+    curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char**)&transfer);
+    curl_multi_remove_handle(multi_handle_, curl_handle);
+    curl_easy_cleanup(curl_handle);
+    curl_slist_free_all(transfer->headers);
+    delete transfer;
+}
+
+bool TileDownloader::ShouldRetry(CURLcode code, long response_code) const {
+    if (code != CURLE_OK) {
+        return true;
+    }
+    return response_code == 429 || response_code >= 500;
+}
+
+// Downloads every requested tile into the response of the same index. A conditional request is complete
+// when it is answered with 304, any other with 200.
+bool TileDownloader::Download(const vector<Request>& requests, vector<HTTPResponse>& responses) {
+    LOG_INFO("TileDownloader", "Downloading {} tiles...", requests.size());
+    auto start_time = chrono::steady_clock::now();
+
+    responses.clear();
+    responses.resize(requests.size());
+    pending_.clear();
+    for (size_t i = 0; i < requests.size(); i++) {
+        pending_.push_back({ i, 0, start_time });
+    }
+
+    size_t completed = 0;
+    size_t not_modified = 0;
+    size_t bytes = 0;
+    vector<CURL*> active;
+    int retries = 0;
+    bool success = true;
+    while (success && completed < requests.size()) {
+        auto now = chrono::steady_clock::now();
+        for (auto it = pending_.begin(); it != pending_.end() && active.size() < parallelism_;) {
+            if (it->not_before <= now) {
+                active.emplace_back(StartTransfer(*it, requests, responses));
+                it = pending_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        int running = 0;
+        curl_multi_perform(multi_handle_, &running);
+        curl_multi_poll(multi_handle_, NULL, 0, 100, NULL);
+
+        int messages = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi_handle_, &messages)) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL* curl_handle = message->easy_handle;
+            CURLcode code = message->data.result;
+            long response_code = 0;
+            Transfer* transfer = NULL;
+            curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &response_code);
+            curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char**)&transfer);
+#ifdef ROUTE_APP_METRICS
+            curl_off_t bytes = 0;
+            curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+            METRICS_COUNT("http.bytes_downloaded", bytes);
+            METRICS_COUNT("http.tile_transfers", 1);
+#endif
+            size_t tile = transfer->tile;
+            int attempt = transfer->attempt;
+            bool conditional = transfer->headers != NULL;
+            FinishTransfer(curl_handle);
+            active.erase(std::remove(active.begin(), active.end(), curl_handle), active.end());
+            const string& bounds = requests[tile].bounds;
+            responses[tile].status = response_code;
+
+            if (code == CURLE_OK && (response_code == 200 || (response_code == 304 && conditional))) {
+                completed++;
+                not_modified += response_code == 304;
+                bytes += responses[tile].body.size();
+            }
+            else if (ShouldRetry(code, response_code) && attempt < max_retries_) {
+                auto backoff = chrono::milliseconds(backoff_ms_ * (1 << attempt));
+                LOG_WARNING("TileDownloader", "Tile {} failed (CURL code {}, HTTP {}), retrying in {} ms...", bounds, code, response_code, backoff.count());
+                pending_.push_back({ tile, attempt + 1, chrono::steady_clock::now() + backoff });
+                retries++;
+            }
+            else {
+                LOG_ERROR("TileDownloader", "Error: Tile {} failed (CURL code {}, HTTP {}).", bounds, code, response_code);
+                success = false;
+            }
+        }
+    }
+
+    for (CURL* curl_handle : active) {
+        FinishTransfer(curl_handle);
+    }
+
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+    LOG_INFO("TileDownloader", "Downloaded {}/{} tiles ({} not modified, {} bytes, {} retries) in {} ms.", completed, requests.size(), not_modified, bytes, retries, elapsed.count());
+    return success;
+}
+
+void TileDownloader::Release() {
+    if (multi_handle_ != NULL) {
+        curl_multi_cleanup(multi_handle_);
+        multi_handle_ = NULL;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef ROUTE_APP_TILE_DOWNLOADER_H
+#define ROUTE_APP_TILE_DOWNLOADER_H
+
+#include <curl/curl.h>
+#include <chrono>
+#include <deque>
+#include "Helper.h"
+#include "HTTPHandler.h"
+
+using namespace std;
+
+namespace route_app {
+
+	// Downloads a large bounding box as a grid of smaller tiles, with several transfers in flight at once
+	// through the libcurl multi interface. Failed transfers are retried with an exponential backoff.
+	class TileDownloader {
+	public:
+		// A tile to download; with the validators of a cached copy, the request is conditional and the
+		// response is a 304 status with an empty body when the copy is still current.
+		struct Request {
+			string bounds;
+			string etag;
+			string last_modified;
+		};
+	private:
+		struct Transfer {
+			size_t tile;
+			int attempt;
+			chrono::steady_clock::time_point not_before;
+			curl_slist* headers = NULL;
+		};
+
+		string query_;
+		size_t parallelism_;
+		int max_retries_;
+		int backoff_ms_;
+		CURLM* multi_handle_ = NULL;
+		deque<Transfer> pending_;
+
+		void Initialize();
+		void Release();
+		CURL* StartTransfer(const Transfer& transfer, const vector<Request>& requests, vector<HTTPResponse>& responses);
+		void FinishTransfer(CURL* curl_handle);
+		bool ShouldRetry(CURLcode code, long response_code) const;
+	public:
+		TileDownloader(string url, string api, string query_prefix, int parallelism, int max_retries, int backoff_ms);
+		~TileDownloader();
+		static vector<string> SplitBounds(double min_lon, double min_lat, double max_lon, double max_lat, double tile_size);
+		bool Download(const vector<Request>& requests, vector<HTTPResponse>& responses);
+	};
+}
+
+#endif
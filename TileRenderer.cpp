@@ -0,0 +1,208 @@
+#include <io2d.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include "Helper.h"
+#include "Logger.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+#include "TileRenderer.h"
+
+using namespace std;
+using namespace route_app;
+
+static const double PI = 3.14159265358979323846264338327950288;
+
+static double TileToLon(int x, int z) {
+    return x / pow(2., z) * 360. - 180.;
+}
+
+static double TileToLat(int y, int z) {
+    return atan(sinh(PI * (1. - 2. * y / pow(2., z)))) * 180. / PI;
+}
+
+static int LonToTile(double lon, int z) {
+    int tiles = 1 << z;
+    return std::clamp((int)floor((lon + 180.) / 360. * tiles), 0, tiles - 1);
+}
+
+static int LatToTile(double lat, int z) {
+    int tiles = 1 << z;
+    double lat_rad = lat * PI / 180.;
+    return std::clamp((int)floor((1. - log(tan(lat_rad) + 1. / cos(lat_rad)) / PI) / 2. * tiles), 0, tiles - 1);
+}
+
+// FNV-1a over the visible pixels of an image; rows are hashed without their stride padding.
+static unsigned long long HashImage(image_surface& image) {
+    unsigned long long hash = 14695981039346656037ULL;
+    image.map([&hash](mapped_surface& surface) {
+        const unsigned char* data = surface.data();
+        size_t row_bytes = (size_t)surface.width() * 4;
+        for (int row = 0; row < surface.height(); row++) {
+            const unsigned char* pixel = data + (size_t)row * surface.stride();
+            for (size_t i = 0; i < row_bytes; i++) {
+                hash = (hash ^ pixel[i]) * 1099511628211ULL;
+            }
+        }
+        });
+    return hash;
+}
+
+// Compares the visible pixels of two images of the same size.
+static bool SamePixels(image_surface& image, image_surface& other) {
+    if (image.width() != other.width() || image.height() != other.height()) {
+        return false;
+    }
+    bool same = true;
+    image.map([&other, &same](mapped_surface& surface) {
+        other.map([&surface, &same](mapped_surface& other_surface) {
+            size_t row_bytes = (size_t)surface.width() * 4;
+            for (int row = 0; row < surface.height() && same; row++) {
+                same = equal(surface.data() + (size_t)row * surface.stride(), surface.data() + (size_t)row * surface.stride() + row_bytes,
+                    other_surface.data() + (size_t)row * other_surface.stride());
+            }
+            });
+        });
+    return same;
+}
+
+// Loads the saved tile and compares its pixels with the image, so that a hash collision cannot link a tile
+// to a different one. A twin that cannot be loaded, e.g. while another worker still saves it, differs.
+static bool SameAsFile(image_surface& image, const string& filename) {
+    try {
+        image_surface saved{ filename, image_file_format::png, format::argb32 };
+        return SamePixels(image, saved);
+    }
+    catch (const exception&) {
+        return false;
+    }
+}
+
+TileRenderer::TileRenderer(Model* model, string directory, int min_zoom, int max_zoom, size_t thread_count) {
+    model_ = model;
+    directory_ = directory;
+    min_zoom_ = min_zoom;
+    max_zoom_ = max_zoom;
+    thread_count_ = std::max<size_t>(1, thread_count);
+    Initialize();
+}
+
+// Lists the tiles of every zoom level that intersect the bounds of the model. Levels whose tiles are far
+// larger or smaller than the map are left out, as the Renderer cannot zoom that far.
+void TileRenderer::Initialize() {
+    double min_lon, min_lat, max_lon, max_lat;
+    model_->GetBounds(min_lon, min_lat, max_lon, max_lat);
+    for (int z = std::max(0, min_zoom_); z <= std::min(max_zoom_, 24); z++) {
+        double tile_width = model_->ProjectCoordinates(TileToLon(1, z), 0.).x - model_->ProjectCoordinates(TileToLon(0, z), 0.).x;
+        if (1. / tile_width < 1. / 16. || 1. / tile_width > 65536.) {
+            LOG_INFO("TileRenderer", "Skipping zoom level {}, its tiles do not fit the map.", z);
+            continue;
+        }
+        for (int x = LonToTile(min_lon, z); x <= LonToTile(max_lon, z); x++) {
+            for (int y = LatToTile(max_lat, z); y <= LatToTile(min_lat, z); y++) {
+                tiles_.push_back(Tile{ z, x, y });
+            }
+        }
+    }
+}
+
+bool TileRenderer::Run() {
+    LOG_INFO("TileRenderer", "Rendering {} tiles into '{}' on {} threads...", tiles_.size(), directory_, thread_count_);
+    auto start_time = chrono::steady_clock::now();
+    scene_ = Renderer(model_).GetScene();
+    vector<WorkerStatistics> statistics(thread_count_);
+    {
+        ThreadPool pool(thread_count_);
+        for (size_t i = 0; i < thread_count_; i++) {
+            pool.Submit([this, &statistics, i]() { Work(statistics[i]); });
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    WorkerStatistics total;
+    for (size_t i = 0; i < statistics.size(); i++) {
+        auto& worker = statistics[i];
+        long long tiles = worker.rendered + worker.empty + worker.duplicates + worker.failed;
+        LOG_INFO("TileRenderer", "Thread {}: {} tiles, {} tiles/s.", i, tiles, worker.seconds > 0. ? tiles / worker.seconds : 0.);
+        total.rendered += worker.rendered;
+        total.empty += worker.empty;
+        total.duplicates += worker.duplicates;
+        total.failed += worker.failed;
+    }
+    LOG_INFO("TileRenderer", "{} tiles written, {} linked to identical tiles, {} empty and {} failed in {} s ({} tiles/s).", total.rendered, total.duplicates, total.empty, total.failed, seconds, seconds > 0. ? tiles_.size() / seconds : 0.);
+    return total.failed == 0;
+}
+
+// Takes tiles off the shared list until it is exhausted; the Renderer, which only reads the shared scene,
+// and the surface are reused for all tiles of the worker.
+void TileRenderer::Work(WorkerStatistics& statistics) {
+    auto start_time = chrono::steady_clock::now();
+    Renderer renderer(model_, scene_);
+    image_surface image{ format::argb32, TILE_SIZE, TILE_SIZE };
+    for (size_t i = next_tile_++; i < tiles_.size(); i = next_tile_++) {
+        const Tile& tile = tiles_[i];
+        Model::Node north_west = model_->ProjectCoordinates(TileToLon(tile.x, tile.z), TileToLat(tile.y, tile.z));
+        Model::Node south_east = model_->ProjectCoordinates(TileToLon(tile.x + 1, tile.z), TileToLat(tile.y + 1, tile.z));
+        Model::Node center;
+        center.x = (north_west.x + south_east.x) / 2.;
+        center.y = (north_west.y + south_east.y) / 2.;
+        float zoom = static_cast<float>(1. / (south_east.x - north_west.x));
+        if (!renderer.RenderTile(image, center, zoom)) {
+            statistics.empty++;
+            continue;
+        }
+        if (!WriteTile(tile, image, statistics)) {
+            statistics.failed++;
+        }
+    }
+    statistics.seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+}
+
+// Saves the tile, or links it to an earlier tile with the same hash whose pixels are equal. A tile whose
+// twin is still being saved by another worker, or differs despite the hash, is saved on its own.
+bool TileRenderer::WriteTile(const Tile& tile, image_surface& image, WorkerStatistics& statistics) {
+    string filename = TileFilename(tile);
+    error_code error;
+    filesystem::create_directories(filesystem::path(filename).parent_path(), error);
+
+    unsigned long long hash = HashImage(image);
+    string twin;
+    {
+        lock_guard<mutex> lock(written_mutex_);
+        auto [it, inserted] = written_tiles_.try_emplace(hash, filename);
+        if (!inserted) {
+            twin = it->second;
+        }
+    }
+    if (!twin.empty() && SameAsFile(image, twin)) {
+        filesystem::remove(filename, error);
+        filesystem::create_hard_link(twin, filename, error);
+        if (!error) {
+            statistics.duplicates++;
+            return true;
+        }
+    }
+
+    try {
+        image.save(filename, image_file_format::png);
+    }
+    catch (const exception& e) {
+        LOG_ERROR("TileRenderer", "Error saving tile '{}': {}", filename, e.what());
+        return false;
+    }
+    statistics.rendered++;
+    return true;
+}
+
+string TileRenderer::TileFilename(const Tile& tile) const {
+    return (filesystem::path(directory_) / to_string(tile.z) / to_string(tile.x) / (to_string(tile.y) + ".png")).string();
+}
+
+void TileRenderer::Release() {
+
+}
+
+TileRenderer::~TileRenderer() {
+    Release();
+}
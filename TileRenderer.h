@@ -0,0 +1,67 @@
+#pragma once
+#ifndef ROUTE_APP_TILE_RENDERER_H
+#define ROUTE_APP_TILE_RENDERER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <io2d.h>
+#include "Model.h"
+#include "Renderer.h"
+
+using namespace std;
+using namespace std::experimental::io2d;
+
+namespace route_app {
+
+	// Renders a pyramid of 256px slippy map tiles (z/x/y.png) over the bounds of a model with the styling
+	// of the Renderer. The tiles are spread over the workers of a thread pool; the workers share the spatial
+	// indexes and levels of detail of one Renderer::Scene, but every worker has its own Renderer, with its
+	// path cache, and image surface. Each tile only draws the features its spatial query returns.
+	// Tiles without features are not written, and tiles whose pixels equal an earlier tile are hard links
+	// to that tile's file.
+	class TileRenderer {
+	public:
+		static const int TILE_SIZE = 256;
+	private:
+		struct Tile {
+			int z;
+			int x;
+			int y;
+		};
+
+		struct WorkerStatistics {
+			long long rendered = 0;
+			long long empty = 0;
+			long long duplicates = 0;
+			long long failed = 0;
+			double seconds = 0.;
+		};
+
+		Model* model_;
+		string directory_;
+		int min_zoom_;
+		int max_zoom_;
+		size_t thread_count_;
+		shared_ptr<const Renderer::Scene> scene_;
+		vector<Tile> tiles_;
+		atomic<size_t> next_tile_{ 0 };
+		mutex written_mutex_;
+		unordered_map<unsigned long long, string> written_tiles_;
+
+		void Initialize();
+		void Release();
+		void Work(WorkerStatistics& statistics);
+		bool WriteTile(const Tile& tile, image_surface& image, WorkerStatistics& statistics);
+		string TileFilename(const Tile& tile) const;
+	public:
+		TileRenderer(Model* model, string directory, int min_zoom, int max_zoom, size_t thread_count);
+		~TileRenderer();
+		bool Run();
+	};
+}
+
+#endif
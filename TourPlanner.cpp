@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include "TourPlanner.h"
+#include "DistanceMatrix.h"
+#include "Helper.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+
+using namespace route_app;
+
+static const double UNREACHABLE = numeric_limits<double>::infinity();
+// Moves must gain at least this many meters, so that rounding errors cannot make the search cycle.
+static const double MIN_GAIN = 1e-7;
+static const size_t MAX_SEGMENT_LENGTH = 3;
+// A double-bridge move cuts the tour into four parts, so smaller tours are only searched once.
+static const size_t MIN_KICKED_TOUR_SIZE = 8;
+
+TourPlanner::TourPlanner(const RoadGraph& graph, const vector<int>& stops) : graph_(graph) {
+	stops_ = stops;
+}
+
+double TourPlanner::TourCost(const vector<int>& tour) const {
+	double cost = 0.;
+	for (size_t i = 0; i < tour.size(); i++) {
+		cost += Cost(tour[i], tour[(i + 1) % tour.size()]);
+	}
+	return cost;
+}
+
+// Starts from the depot and repeatedly inserts the stop nearest to the tour where it lengthens the tour least.
+vector<int> TourPlanner::InsertNearest(const vector<int>& stops) const {
+	vector<int> tour{ stops[0] };
+	vector<double> nearest(stops.size());
+	vector<char> in_tour(stops.size(), 0);
+	in_tour[0] = 1;
+	for (size_t k = 0; k < stops.size(); k++) {
+		nearest[k] = Cost(stops[0], stops[k]);
+	}
+	for (size_t step = 1; step < stops.size(); step++) {
+		size_t next = 0;
+		for (size_t k = 1; k < stops.size(); k++) {
+			if (!in_tour[k] && (next == 0 || nearest[k] < nearest[next])) {
+				next = k;
+			}
+		}
+		int stop = stops[next];
+		size_t best_position = 0;
+		double best_increase = UNREACHABLE;
+		for (size_t i = 0; i < tour.size(); i++) {
+			int from = tour[i], to = tour[(i + 1) % tour.size()];
+			double increase = Cost(from, stop) + Cost(stop, to) - Cost(from, to);
+			if (increase < best_increase) {
+				best_increase = increase;
+				best_position = i + 1;
+			}
+		}
+		tour.insert(tour.begin() + best_position, stop);
+		in_tour[next] = 1;
+		for (size_t k = 1; k < stops.size(); k++) {
+			nearest[k] = std::min(nearest[k], Cost(stop, stops[k]));
+		}
+	}
+	return tour;
+}
+
+// Replaces the edges (a, b) and (c, d) with (a, c) and (b, d) by reversing the part from b to c. The road
+// distances are symmetric, so the reversed part keeps its length. The depot stays first.
+bool TourPlanner::TwoOpt(vector<int>& tour, Deadline deadline) const {
+	bool improved = false;
+	size_t size = tour.size();
+	for (size_t i = 0; i + 2 < size && chrono::steady_clock::now() < deadline; i++) {
+		for (size_t j = i + 2; j < size; j++) {
+			if (i == 0 && j == size - 1) {
+				continue;
+			}
+			int a = tour[i], b = tour[i + 1], c = tour[j], d = tour[(j + 1) % size];
+			if (Cost(a, c) + Cost(b, d) < Cost(a, b) + Cost(c, d) - MIN_GAIN) {
+				reverse(tour.begin() + i + 1, tour.begin() + j + 1);
+				improved = true;
+			}
+		}
+	}
+	return improved;
+}
+
+// Moves a part of one to three stops, either way round, between two other neighbouring stops.
+bool TourPlanner::OrOpt(vector<int>& tour, Deadline deadline) const {
+	bool improved = false;
+	size_t size = tour.size();
+	for (size_t length = 1; length <= MAX_SEGMENT_LENGTH && length + 2 <= size; length++) {
+		for (size_t i = 1; i + length <= size && chrono::steady_clock::now() < deadline; i++) {
+			int previous = tour[i - 1], first = tour[i], last = tour[i + length - 1], next = tour[(i + length) % size];
+			double removal_gain = Cost(previous, first) + Cost(last, next) - Cost(previous, next);
+			for (size_t j = 0; j < size; j++) {
+				if (j + 1 >= i && j < i + length) {
+					continue;
+				}
+				int from = tour[j], to = tour[(j + 1) % size];
+				double increase = Cost(from, first) + Cost(last, to) - Cost(from, to);
+				double reversed_increase = Cost(from, last) + Cost(first, to) - Cost(from, to);
+				if (std::min(increase, reversed_increase) < removal_gain - MIN_GAIN) {
+					vector<int> segment(tour.begin() + i, tour.begin() + i + length);
+					if (reversed_increase < increase) {
+						reverse(segment.begin(), segment.end());
+					}
+					tour.erase(tour.begin() + i, tour.begin() + i + length);
+					size_t position = (j < i ? j : j - length) + 1;
+					tour.insert(tour.begin() + position, segment.begin(), segment.end());
+					improved = true;
+					break;
+				}
+			}
+		}
+	}
+	return improved;
+}
+
+// Applies 2-opt and Or-opt moves until neither improves the tour or the deadline has passed.
+void TourPlanner::LocalSearch(vector<int>& tour, Deadline deadline) const {
+	while (chrono::steady_clock::now() < deadline) {
+		bool improved = TwoOpt(tour, deadline);
+		improved |= OrOpt(tour, deadline);
+		if (!improved) {
+			break;
+		}
+	}
+}
+
+// Cuts the tour after the depot into the parts A B C D and reconnects them as A C B D.
+void TourPlanner::Kick(vector<int>& tour, mt19937& generator) const {
+	uniform_int_distribution<size_t> position(1, tour.size() - 1);
+	size_t cuts[3];
+	do {
+		for (auto& cut : cuts) {
+			cut = position(generator);
+		}
+		sort(begin(cuts), end(cuts));
+	} while (cuts[0] == cuts[1] || cuts[1] == cuts[2]);
+	rotate(tour.begin() + cuts[0], tour.begin() + cuts[1], tour.begin() + cuts[2]);
+}
+
+// Iterated local search on one thread; a kicked tour replaces the thread's tour only if it is shorter.
+// Returns the number of local searches run.
+long long TourPlanner::Improve(unsigned int seed, Deadline deadline) {
+	mt19937 generator(seed);
+	vector<int> tour;
+	{
+		lock_guard<mutex> lock(mutex_);
+		tour = tour_;
+	}
+	double cost = TourCost(tour);
+	long long searches = 0;
+	while (chrono::steady_clock::now() < deadline) {
+		vector<int> candidate = tour;
+		Kick(candidate, generator);
+		LocalSearch(candidate, deadline);
+		searches++;
+		double candidate_cost = TourCost(candidate);
+		if (candidate_cost < cost - MIN_GAIN) {
+			tour = std::move(candidate);
+			cost = candidate_cost;
+			lock_guard<mutex> lock(mutex_);
+			if (cost < cost_) {
+				tour_ = tour;
+				cost_ = cost;
+			}
+		}
+	}
+	return searches;
+}
+
+// Computes the distances between the stops on thread_count threads, then plans the tour; the budget
+// bounds the time of the local search.
+bool TourPlanner::Plan(size_t thread_count, chrono::milliseconds budget) {
+	METRICS_SCOPE("tour_planner.plan");
+	tour_.clear();
+	cost_ = 0.;
+	if (stops_.empty()) {
+		LOG_ERROR("TourPlanner", "Error: There are no stops to plan a tour for.");
+		return false;
+	}
+	DistanceMatrix matrix(graph_, stops_, stops_);
+	matrix.Compute(thread_count);
+	costs_.resize(stops_.size() * stops_.size());
+	for (size_t from = 0; from < stops_.size(); from++) {
+		for (size_t to = 0; to < stops_.size(); to++) {
+			costs_[from * stops_.size() + to] = matrix.Get(from, to);
+		}
+	}
+
+	vector<int> reachable;
+	for (size_t stop = 0; stop < stops_.size(); stop++) {
+		if (Cost(0, (int)stop) != UNREACHABLE) {
+			reachable.emplace_back((int)stop);
+		}
+	}
+	if (reachable.size() < stops_.size()) {
+		LOG_WARNING("TourPlanner", "Warning: {} of {} stops cannot be reached from the depot and are left out.", stops_.size() - reachable.size(), stops_.size());
+	}
+
+	auto start_time = chrono::steady_clock::now();
+	Deadline deadline = start_time + budget;
+	tour_ = InsertNearest(reachable);
+	double insertion_cost = TourCost(tour_);
+	LocalSearch(tour_, deadline);
+	cost_ = TourCost(tour_);
+	atomic<long long> searches{ 1 };
+	if (tour_.size() >= MIN_KICKED_TOUR_SIZE) {
+		ThreadPool pool(thread_count);
+		for (size_t i = 0; i < pool.GetThreadCount(); i++) {
+			pool.Submit([this, i, deadline, &searches]() {
+				searches += Improve((unsigned int)i + 1, deadline);
+			});
+		}
+	}
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time);
+	METRICS_COUNT("tour_planner.local_searches", searches.load());
+	LOG_INFO("TourPlanner", "Tour of {} stops: {} m by nearest insertion, {} m after {} local searches in {} ms.", tour_.size(), insertion_cost, cost_, searches.load(), elapsed.count());
+	return true;
+}
+
+// Stitches the road routes between consecutive stops, back to the depot, into one route.
+bool TourPlanner::BuildRoute(RoadGraph::Route& route) const {
+	route.nodes.clear();
+	route.distance = 0.;
+	for (size_t i = 0; i < tour_.size(); i++) {
+		RoadGraph::Route leg;
+		if (!graph_.FindRoute(stops_[tour_[i]], stops_[tour_[(i + 1) % tour_.size()]], leg)) {
+			LOG_ERROR("TourPlanner", "Error: No route found from stop {} to stop {}.", tour_[i], tour_[(i + 1) % tour_.size()]);
+			return false;
+		}
+		route.nodes.insert(route.nodes.end(), leg.nodes.begin() + (route.nodes.empty() ? 0 : 1), leg.nodes.end());
+		route.distance += leg.distance;
+	}
+	return true;
+}
+
+// One line per stop in the order of the tour: the index of the stop and the road distance in meters
+// from the depot to it along the tour.
+bool TourPlanner::Write(const string& filename) const {
+	ofstream file(filename);
+	if (!file) {
+		LOG_ERROR("TourPlanner", "Error opening file '{}'.", filename);
+		return false;
+	}
+	file << fixed << setprecision(1);
+	double distance = 0.;
+	for (size_t i = 0; i < tour_.size(); i++) {
+		if (i > 0) {
+			distance += Cost(tour_[i - 1], tour_[i]);
+		}
+		file << tour_[i] << ',' << distance << '\n';
+	}
+	if (!file) {
+		LOG_ERROR("TourPlanner", "Error writing file '{}'.", filename);
+		return false;
+	}
+	LOG_INFO("TourPlanner", "Tour written to '{}'.", filename);
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef ROUTE_APP_TOUR_PLANNER_H
+#define ROUTE_APP_TOUR_PLANNER_H
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "RoadGraph.h"
+
+using namespace std;
+
+namespace route_app {
+
+	// Orders the stops of a delivery round, from a few to a few hundred, into a short round trip that starts
+	// and ends at the first stop, the depot. The road distances between the stops are computed as a
+	// DistanceMatrix; the tour is built by nearest insertion and improved by 2-opt and Or-opt moves. While
+	// the time budget lasts, every thread then kicks its own copy of the tour with a random double-bridge
+	// move and improves it again, keeping the shortest tour found. Stops that cannot be reached from the
+	// depot are left out. Stops are model node numbers and the tour holds their indices.
+	class TourPlanner {
+	private:
+		typedef chrono::steady_clock::time_point Deadline;
+
+		const RoadGraph& graph_;
+		vector<int> stops_;
+		vector<double> costs_;
+		vector<int> tour_;
+		double cost_ = 0.;
+		mutex mutex_;
+
+		double Cost(int from, int to) const { return costs_[from * stops_.size() + to]; }
+		double TourCost(const vector<int>& tour) const;
+		vector<int> InsertNearest(const vector<int>& stops) const;
+		bool TwoOpt(vector<int>& tour, Deadline deadline) const;
+		bool OrOpt(vector<int>& tour, Deadline deadline) const;
+		void LocalSearch(vector<int>& tour, Deadline deadline) const;
+		void Kick(vector<int>& tour, mt19937& generator) const;
+		long long Improve(unsigned int seed, Deadline deadline);
+	public:
+		TourPlanner(const RoadGraph& graph, const vector<int>& stops);
+		bool Plan(size_t thread_count, chrono::milliseconds budget);
+		bool BuildRoute(RoadGraph::Route& route) const;
+		bool Write(const string& filename) const;
+		const vector<int>& GetTour() const { return tour_; }
+		double GetCost() const { return cost_; }
+	};
+}
+
+#endif